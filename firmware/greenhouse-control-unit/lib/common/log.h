@@ -15,6 +15,7 @@
 #define TRACE(line) common::log::trace(line)
 #define TRACE_F(format, ...) common::log::trace(format, __VA_ARGS__)
 #define TRACE_C(line) TRACE(line)
+#define BOOL_FS(b) (b ? "true" : "false")
 
 #endif // ARDUINO
 
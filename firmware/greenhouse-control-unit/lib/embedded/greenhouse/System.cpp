@@ -59,6 +59,9 @@ const int k_blynkRecoverTimeSec = 300; // 5m
 const int k_serialWaitDelay = 1000;    // 1s
 const int k_leftWindowNodeSwitch = 1;
 const int k_rightWindowNodeSwitch = 2;
+const int k_soilTempPushInterval = 60;   // 60s
+const float k_soilTempPushDelta = 0.25f; // °C
+const uint8_t k_soilTempResolution = 10; // bits; 0.25°C, as fine as the push delta
 
 static System *s_instance = nullptr;
 static PCF8574 s_localSystemIo1(k_localSystemIoAddress1);
@@ -152,6 +155,20 @@ void System::Setup()
 #if RADIO_EN
   TRACE("Init radio");
   m_radio.Init(this);
+
+  // the soil temperature probes are on the right window node.
+  m_rightWindow = m_radio.AddNode(GH_ADDR_NODE_1, radio::k_capMotor | radio::k_capTemps);
+  m_leftWindow = m_radio.AddNode(GH_ADDR_NODE_2, radio::k_capMotor);
+
+  // faster links need the hc-12 set pin wired (see HC12_SET_EN).
+#if HC12_SET_EN
+  m_rightWindow->LinkMax(GH_LINK_FAST);
+  m_leftWindow->LinkMax(GH_LINK_FAST);
+#endif // HC12_SET_EN
+
+  // soil node pushes readings, so refresh doesn't have to poll it.
+  m_rightWindow->SubscribeTemps(k_soilTempPushInterval, k_soilTempPushDelta);
+  m_rightWindow->TempResolution(k_soilTempResolution);
 #endif // RADIO_EN
 
 #if PUMP_RADIO_EN
@@ -165,6 +182,12 @@ void System::Setup()
 
 void System::Loop()
 {
+#if RADIO_EN
+  // run on every loop (not just once per second), so that radio
+  // responses and retries are handled without blocking.
+  m_radio.Loop();
+#endif // RADIO_EN
+
   if (millis() < (m_lastLoop + k_loopFrequency)) {
     delay(LOOP_DELAY);
     return;
@@ -194,6 +217,17 @@ void System::Loop()
       PrintStatus();
       break;
 
+#if RADIO_EN
+    case 't':
+      m_rightWindow->RescanTemps();
+      break;
+
+    // traced when the response arrives.
+    case 'h':
+      m_rightWindow->RequestTempStats();
+      break;
+#endif // RADIO_EN
+
     default:
       PrintCommands();
       break;
@@ -393,14 +427,18 @@ void System::UpdateSoilTemp()
 {
 #if RADIO_EN
   TRACE("Reading soil temperatures");
-  radio::Node &rightWindow = m_radio.Node(radio::k_nodeRightWindow);
-  const int tempDevs = rightWindow.GetTempDevs();
 
-  TRACE_F("Soil temperature devices: %d", tempDevs);
+  // the node pushes readings in the background, so just use the latest;
+  // no data means the pushes (and fallback polls) have stopped.
+  radio::TempData tempData;
+  tempData.devs = 0;
+  m_rightWindow->Temps(tempData);
+
+  TRACE_F("Soil temperature devices: %d", tempData.devs);
   float tempSum = 0;
   int tempValues = 0;
-  for (int i = 0; i < tempDevs; i++) {
-    const float t = rightWindow.GetTemp(i);
+  for (int i = 0; i < tempData.devs; i++) {
+    const float t = tempData.temps[i];
     if (t != k_unknown) {
       tempSum += t;
       tempValues++;
@@ -439,11 +477,14 @@ void System::RunWindowActuator(bool extend, float delta)
     runtimeSec);
 
 #if RADIO_EN
+  // closing for rain goes ahead of everything else on the radio.
+  const bool rain = !extend && (WeatherCode() != k_unknown) && IsRaining();
+  const radio::SendPriority priority = rain ? radio::k_prioritySafety : radio::k_priorityUser;
   if (extend) {
-    m_radio.MotorRunAll(radio::k_windowExtend, runtimeSec);
+    m_radio.MotorRunAll(radio::k_windowExtend, runtimeSec, priority);
   }
   else {
-    m_radio.MotorRunAll(radio::k_windowRetract, runtimeSec);
+    m_radio.MotorRunAll(radio::k_windowRetract, runtimeSec, priority);
   }
 #endif // RADIO_EN
 }
@@ -726,11 +767,15 @@ void System::WriteOnboardIO(uint8_t pin, uint8_t value)
   s_localSystemIo1.digitalWrite(pin, value);
 }
 
-void System::PrintCommands() { TRACE("Commands\ns: status"); }
+void System::PrintCommands() { TRACE("Commands\ns: status\nt: rescan soil temperature probes\nh: soil temperature history"); }
 
 void System::PrintStatus()
 {
   TRACE_F("Status\nBlynk: %s", Blynk.connected() ? "Connected" : "Disconnected");
+
+#if RADIO_EN
+  m_radio.PrintStats();
+#endif // RADIO_EN
 }
 
 void System::QueueCallback(CallbackFunction f, std::string name)
@@ -741,10 +786,8 @@ void System::QueueCallback(CallbackFunction f, std::string name)
 void System::WindowSpeedUpdate()
 {
 #if RADIO_EN
-  radio::Node &left = m_radio.Node(radio::k_nodeLeftWindow);
-  radio::Node &right = m_radio.Node(radio::k_nodeRightWindow);
-  left.MotorSpeed(WindowSpeedLeft());
-  right.MotorSpeed(WindowSpeedRight());
+  m_leftWindow->MotorSpeed(WindowSpeedLeft());
+  m_rightWindow->MotorSpeed(WindowSpeedRight());
 #endif // RADIO_EN
 }
 
@@ -136,6 +136,8 @@ private:
   int m_windowSpeedRight;
 #if RADIO_EN
   Radio m_radio;
+  radio::Node *m_rightWindow = nullptr;
+  radio::Node *m_leftWindow = nullptr;
 #endif // RADIO_EN
 };
 
@@ -1,514 +1,233 @@
 #include "NodeRadio.h"
 
-#define RADIO_TRACE
-
 #if NODE_RADIO_EN
 
-#include "../../common/common.h"
 #include "ISystem.h"
 
+#include <PCF8574.h>
+
+#ifndef RADIO_HW_UART
+#define RADIO_HW_UART 0
+#endif
+
+#if !RADIO_HW_UART
 #include <SoftwareSerial.h>
+#endif
+
+// hc-12 set pin wired to IO_PIN_HC12_SET; not on the board as made, so
+// without it the link stays robust.
+#ifndef HC12_SET_EN
+#define HC12_SET_EN 0
+#endif
 
+// pins are named for the hc-12 side.
 #define PIN_RX 14
 #define PIN_TX 27
 #define BAUD 9600
-#define RX_TIMEOUT 500
-#define TX_WAIT_DELAY 20
-#define TX_RETRY_MAX 5
-#define LINEAR_TIMEOUT 1
-#define TEMP_OFFSET -1.2
-#define TEMP_UNKNOWN 255
-#define KEEP_ALIVE_TIME 60000 // 60s
-#define RECONNECT_TIME 10000  // 10s
-
-#ifndef RADIO_TRACE
-#undef TRACE
-#define TRACE(l)
-#undef TRACE_F
-#define TRACE_F(...)
-#endif // RADIO_TRACE
+#define AT_SET_DELAY 80     // to enter or leave at command mode
+#define AT_CMD_DELAY 100    // for an at command to be answered
+#define RX_READ_TIMEOUT 100 // max wait for the rest of a frame
+#define RX_BUFFER_SIZE 256  // hw uart ring buffer, several frames
+#define UART_NUM 2
+#define IO_PIN_HC12_SET P7  // low for at command mode (needs HC12_SET_EN)
 
 namespace embedded {
 namespace greenhouse {
 
+#if RADIO_HW_UART
+// the uart driver fills a ring buffer from its rx interrupt, so the cpu
+// isn't busy sampling bits, and bytes aren't dropped when wifi or i2c
+// interrupts hold things up. frames are parsed from the buffer as usual.
+static HardwareSerial s_hc12(UART_NUM);
+#else
 static SoftwareSerial s_hc12(PIN_TX, PIN_RX);
-static uint8_t s_rxBuf[GH_LENGTH];
-static uint8_t s_txBuf[GH_LENGTH];
-
-void printBuffer(const __FlashStringHelper *prompt, const uint8_t *data, uint8_t dataLen);
+#endif // RADIO_HW_UART
 
-Radio::Radio() : m_system(nullptr), m_requests(0), m_errors(0) {}
+Radio::Radio() :
+  m_system(nullptr),
+  m_linkStep(k_linkIdle),
+  m_linkStepAt(0),
+  m_linkFrom(GH_LINK_ROBUST),
+  m_linkTo(GH_LINK_ROBUST)
+{
+}
 
 void Radio::Init(ISystem *system)
 {
-  TRACE("Radio init");
   m_system = system;
 
+#if RADIO_HW_UART
+  s_hc12.setRxBufferSize(RX_BUFFER_SIZE);
+  s_hc12.begin(BAUD, SERIAL_8N1, PIN_TX, PIN_RX);
+#else
   s_hc12.begin(BAUD);
+#endif // RADIO_HW_UART
+  s_hc12.setTimeout(RX_READ_TIMEOUT);
 
-  m_nodes[radio::k_nodeRightWindow].Init(*this, GH_ADDR_NODE_1);
-  m_nodes[radio::k_nodeLeftWindow].Init(*this, GH_ADDR_NODE_2);
-}
-
-void Radio::Update()
-{
-  for (int i = 0; i < RADIO_NODES_MAX; i++) {
-    m_nodes[i].Update();
-  }
+  native::greenhouse::Radio::Init(*this);
 }
 
 String Radio::DebugInfo()
 {
   String debug;
-  for (int i = 0; i < RADIO_NODES_MAX; i++) {
-    radio::Node &node = m_nodes[i];
+  for (int i = 0; i < NodeCount(); i++) {
+    radio::Node &node = Node(i);
     char buf[200];
-    String f = String(F("%d:{addr=%02Xh, err=%d} "));
-    sprintf(buf, f.c_str(), i, node.Address(), node.Errors());
+    const radio::RttHistogram &rtt = node.Stats().rtt;
+    String f = String(F("%d:{addr=%02Xh, err=%d, rto=%lums, rtt=%lu/%lu/%lums} "));
+    sprintf(
+      buf,
+      f.c_str(),
+      i,
+      node.Address(),
+      node.Errors(),
+      node.Rto(),
+      rtt.Percentile(50),
+      rtt.Percentile(95),
+      rtt.Max());
     debug += buf;
   }
   return debug;
 }
 
-radio::Node &Radio::Node(radio::NodeId index)
+void Radio::PrintStats()
 {
-  if (index < 0 || index >= RADIO_NODES_MAX) {
-    TRACE_F("Fatal: Radio node out of bounds, index=%d", (int)index);
-    common::halt();
-  }
-  return m_nodes[index];
-}
+  TRACE_F("Radio utilisation: %.1f%% (max %.1f%%)", Utilisation() * 100, DutyCycleMax() * 100);
 
-void Radio::sr(int pin, bool set) { m_system->WriteOnboardIO(pin, set); }
-
-bool Radio::Send(radio::SendDesc &sendDesc)
-{
-  bool rx = false;
-  for (int i = 0; i < TX_RETRY_MAX; i++) {
+  for (int i = 0; i < NodeCount(); i++) {
+    radio::Node &node = Node(i);
+    const radio::NodeStats &stats = node.Stats();
 
     TRACE_F(
-      "Radio sending, attempt=%d, to=%02Xh, cmd=%02Xh, seq=%d",
-      i + 1,
-      sendDesc.to,
-      sendDesc.cmd,
-      sendDesc.seq);
-
-    GH_TO(s_txBuf) = sendDesc.to;
-    GH_FROM(s_txBuf) = GH_ADDR_MAIN;
-    GH_CMD(s_txBuf) = sendDesc.cmd;
-    GH_DATA_1(s_txBuf) = sendDesc.data1;
-    GH_DATA_2(s_txBuf) = sendDesc.data2;
-
-    sendDesc.seq = sendDesc.seq % 256;
-    GH_SEQ(s_txBuf) = sendDesc.seq;
-
-    m_requests++;
-
-    // clear anything left in the RX buffer, otherwise when we're
-    // checking for a response, we may get an out of sync message.
-    int bitsDumped = 0;
-    while (s_hc12.read() != -1) {
-      bitsDumped++;
-    }
-
-    TRACE_F("Radio read bits dumped: %d", bitsDumped);
-
-    s_hc12.write(s_txBuf, GH_LENGTH);
-
-    unsigned long start = millis();
-
-    printBuffer(F("Radio sent data: "), s_txBuf, GH_LENGTH);
-
-    int timeout = RX_TIMEOUT;
-#if LINEAR_TIMEOUT
-    // linear timeout increase; 433MHz is a very busy frequency,
-    // and we don't want to fight with another retry loop.
-    // don't wait for long on the last retry.
-    if ((i != 0) && (i != (TX_RETRY_MAX - 1))) {
-      TRACE("Radio response timout increased");
-      timeout *= i + 1;
-    }
-#endif // LINEAR_TIMEOUT
-    TRACE_F("Radio waiting for response, timeout: %dms", timeout);
-
-    while (millis() < (start + timeout)) {
-      uint8_t s_rxBufLen = sizeof(s_rxBuf);
-
-      if (s_hc12.available()) {
-        s_rxBufLen = s_hc12.readBytes(s_rxBuf, GH_LENGTH);
-        if (s_rxBufLen != GH_LENGTH) {
-          TRACE_F(
-            "Error: Buffer underrun while waiting for %02Xh: %d", sendDesc.to, GH_DATA_1(s_rxBuf));
-          m_errors++;
-          sendDesc.errors++;
-          break;
-        }
-
-        TRACE_F("Radio response time: %lums", millis() - start);
-        printBuffer(F("Radio got data: "), s_rxBuf, GH_LENGTH);
-
-        if ((GH_TO(s_rxBuf) == GH_ADDR_MAIN) && (GH_FROM(s_rxBuf) == sendDesc.to)) {
-
-          if (GH_CMD(s_rxBuf) == GH_CMD_ERROR) {
-            TRACE_F("Error: Code from node %02Xh: %d", sendDesc.to, GH_DATA_1(s_rxBuf));
-            m_errors++;
-            sendDesc.errors++;
-            continue;
-          }
-          else if (GH_CMD(s_rxBuf) != sendDesc.expectCmd) {
-            TRACE("Error: Radio got unexpected command");
-            m_errors++;
-            sendDesc.errors++;
-            continue;
-          }
-          else if (sendDesc.okCallback != NULL) {
-            sendDesc.okCallbackResult = sendDesc.okCallback(sendDesc);
-            if (!sendDesc.okCallbackResult) {
-              TRACE("Error: Radio OK callback failed");
-              m_errors++;
-              sendDesc.errors++;
-              continue;
-            }
-          }
-
-          rx = true;
-          break;
-        }
-        else {
-          TRACE("Radio ignoring message (address mismatch)");
-          // don't report an error, this is fine
-        }
+      "Radio node %02Xh: rtt={n=%lu, p50=%lums, p95=%lums, max=%lums}, rto=%lums, fec=%s, corrected=%lu",
+      node.Address(),
+      stats.rtt.Count(),
+      stats.rtt.Percentile(50),
+      stats.rtt.Percentile(95),
+      stats.rtt.Max(),
+      node.Rto(),
+      BOOL_FS(node.Fec()),
+      stats.fecCorrected);
+
+    for (int cmd = 0; cmd < radio::k_statsCmdCount; cmd++) {
+      const unsigned long *counts = stats.counts[cmd];
+      if (counts[radio::k_statsAttempts] == 0) {
+        continue;
       }
-      delay(1); // prevent WDT reset
-    }
 
-    if (rx) {
-      break;
-    }
-    else {
-      TRACE("Error: Radio timeout");
-      m_errors++;
-      sendDesc.errors++;
+      TRACE_F(
+        "  %s: attempts=%lu, ok=%lu, failed=%lu, timeouts=%lu, corrupt=%lu, unexpected=%lu, "
+        "expired=%lu",
+        radio::statsCmdName((radio::StatsCmd)cmd),
+        counts[radio::k_statsAttempts],
+        counts[radio::k_statsOk],
+        counts[radio::k_statsFailed],
+        counts[radio::k_statsTimeouts],
+        counts[radio::k_statsCorrupt],
+        counts[radio::k_statsUnexpected],
+        counts[radio::k_statsExpired]);
     }
   }
-
-  TRACE_F(
-    "Radio stats, rx=%s, errors={now: %d, total: %d}, requests=%d",
-    BOOL_FS(rx),
-    sendDesc.errors,
-    m_errors,
-    m_requests);
-
-  return rx;
 }
 
-void Radio::MotorRunAll(radio::MotorDirection direction, byte seconds)
-{
-  const int windowNodes = 2;
-  const int motorBusyWait = 1000;
-  const int busyCheckMax = 60;
-
-  radio::NodeId nodes[windowNodes];
-  nodes[0] = radio::k_nodeRightWindow;
-  nodes[1] = radio::k_nodeLeftWindow;
-
-  for (int i = 0; i < windowNodes; i++) {
-    radio::Node &node = Node(nodes[i]);
-
-    int busyChecks = 0;
-    bool motorBusy = false, motorStateRx = false;
-    do {
-      if (busyChecks++ >= busyCheckMax) {
-        TRACE_F("Error: Radio motor run busy checks exceeded maximum, node=%02Xh", node.Address());
-        break;
-      }
-      motorStateRx = node.MotorState(motorBusy);
-      if (!motorStateRx) {
-        break;
-      }
-      if (motorBusy) {
-        TRACE("Motor is busy, waiting");
-        m_system->Delay(motorBusyWait, "Motor busy wait");
-      }
-    } while (motorBusy);
-
-    if (motorStateRx && !motorBusy) {
-      node.MotorRun(direction, seconds);
-    }
-  }
-}
-
-// begin node class
-
-namespace radio {
-
-Node::Node() :
-  m_init(false),
-  m_radio(nullptr),
-  m_address(UNKNOWN_ADDRESS),
-  m_helloOk(false),
-  m_keepAliveExpiry(common::k_unknownUL),
-  m_nextReconnect(common::k_unknownUL),
-  m_sequence(1),
-  m_errors(0)
-{
-}
-
-void Node::Init(embedded::greenhouse::Radio &radio, byte address)
-{
-  TRACE_F("Init radio node, address=%02Xh", address);
-  m_radio = &radio;
-  m_address = address;
-  if (hello()) {
-    TRACE_F("Radio node online: %02Xh", m_address);
-  }
-  else {
-    TRACE_F("Radio node offline: %02Xh", m_address);
-  }
-  m_init = true;
-}
-
-void Node::Update()
-{
-  if (!m_init) {
-    return;
-  }
-
-  if (m_helloOk) {
-    keepAlive();
-  }
-  else {
-    if (millis() > m_nextReconnect) {
-      TRACE_F("Reconnecting to node: %02Xh", m_address);
-      if (hello()) {
-        TRACE_F("Radio node online: %02Xh", m_address);
-      }
-      else {
-        TRACE_F("Failed to reconnect to node: %02Xh", m_address);
-      }
-    }
-  }
-}
-
-bool Node::Online() { return m_helloOk && !keepAliveExpired(); }
-
-void Node::stepSequence()
-{
-  if (m_sequence == 255) {
-    m_sequence = 0;
-  }
-  else {
-    m_sequence++;
-  }
-}
-
-bool Node::keepAliveExpired() { return millis() > m_keepAliveExpiry; }
-
-bool Node::keepAlive()
-{
-  if (keepAliveExpired()) {
-    TRACE_F("Radio keep alive expired, saying hello to node: %02Xh", m_address);
-    if (!hello()) {
-      TRACE_F("Error: Radio keep alive failed, node offline: %02Xh", m_address);
-      return false;
-    }
-  }
-  return m_helloOk;
-}
-
-bool helloOk(SendDesc &sendDesc)
-{
-  const byte rxSeq = GH_SEQ(s_rxBuf);
-  if (rxSeq != sendDesc.seq) {
-    TRACE_F("Error: Radio ack invalid, sequence: %d!=%d", rxSeq, sendDesc.seq);
-    return false;
-  }
-
-  return true;
-}
-
-bool Node::send(radio::SendDesc &sendDesc)
-{
-  sendDesc.seq = m_sequence;
-  bool ok = Radio().Send(sendDesc);
-  m_errors += sendDesc.errors;
-  TRACE_F("Total errors for node %02Xh: %d", m_address, m_errors);
-  stepSequence();
-  return ok;
-}
+void Radio::sr(int pin, bool set) { m_system->WriteOnboardIO(pin, set); }
 
-bool Node::hello()
+void Radio::baud(unsigned long rate)
 {
-  TRACE_F("Radio saying hello to %02Xh", m_address);
-
-  SendDesc sd;
-  sd.to = m_address;
-  sd.cmd = GH_CMD_HELLO;
-  sd.okCallback = &helloOk;
-  bool rxOk = send(sd);
-
-  m_helloOk = rxOk && sd.okCallbackResult;
-  if (m_helloOk) {
-    m_keepAliveExpiry = millis() + KEEP_ALIVE_TIME;
-  }
-  else {
-    m_nextReconnect = millis() + RECONNECT_TIME;
-    TRACE_F(
-      "Error: Radio hello failed, rx=%s, ack=%s", BOOL_FS(rxOk), BOOL_FS(sd.okCallbackResult));
-  }
-
-  return m_helloOk;
+#if RADIO_HW_UART
+  s_hc12.updateBaudRate(rate);
+#else
+  s_hc12.begin(rate);
+#endif // RADIO_HW_UART
 }
 
-bool tempDevsOk(SendDesc &sendDesc)
-{
-  radio::TempData *data = (radio::TempData *)sendDesc.okCallbackArg;
-  data->devs = GH_DATA_1(s_rxBuf);
-  TRACE_F("Got temperature device count: %d", data->devs);
-  return true;
-}
+#if HC12_SET_EN
 
-int Node::GetTempDevs()
+// with set pulled low while powered, the module takes commands at its
+// current baud (9600 is only for set held low at power up).
+void Radio::Link(uint8_t from, uint8_t to)
 {
-  if (!keepAlive()) {
-    return common::k_unknown;
-  }
-
-  TRACE("Getting temperature device count");
-
-  radio::SendDesc sd;
-  sd.to = m_address;
-  sd.cmd = GH_CMD_TEMP_DEVS_REQ;
-  sd.expectCmd = GH_CMD_TEMP_DEVS_RSP;
-  sd.okCallback = &tempDevsOk;
-  sd.okCallbackArg = &m_tempData;
-
-  m_tempData.devs = common::k_unknown;
-
-  if (send(sd)) {
-    return m_tempData.devs;
-  }
-  else {
-    return common::k_unknown;
-  }
-}
+  // anything still going out would be cut off.
+  s_hc12.flush();
 
-bool tempDataOk(SendDesc &sendDesc)
-{
-  TempDataCallbackArg *arg = (TempDataCallbackArg *)sendDesc.okCallbackArg;
-  const uint8_t a = GH_DATA_1(s_rxBuf);
-  const uint8_t b = GH_DATA_2(s_rxBuf);
-  TRACE_F("Got temperature data, a=%02Xh b=%02Xh", a, b);
-  if (b != TEMP_UNKNOWN) {
-    arg->data->temps[arg->dev] = b * 16.0 + a / 16.0;
-  }
-  return true;
+  sr(IO_PIN_HC12_SET, LOW);
+  m_linkFrom = from;
+  m_linkTo = to;
+  m_linkStep = k_linkSetLow;
+  m_linkStepAt = millis();
 }
 
-float Node::GetTemp(byte index)
+bool Radio::LinkDone()
 {
-  if (!keepAlive()) {
-    return common::k_unknown;
-  }
-
-  TRACE_F("Getting temperature value from device: %d", index);
+  const unsigned long elapsed = millis() - m_linkStepAt;
+  switch (m_linkStep) {
+    case k_linkIdle:
+      return true;
 
-  SendDesc sd;
-  sd.to = m_address;
-  sd.cmd = GH_CMD_TEMP_DATA_REQ;
-  sd.expectCmd = GH_CMD_TEMP_DATA_RSP;
-  sd.data1 = index;
+    case k_linkSetLow:
+      if (elapsed < AT_SET_DELAY) {
+        return false;
+      }
+      baud(GH_LINK_BAUD(m_linkFrom));
+      s_hc12.print(F("AT+FU3"));
+      m_linkStep = k_linkFu;
+      break;
 
-  TempDataCallbackArg arg;
-  arg.dev = index;
-  arg.data = &m_tempData;
-  sd.okCallbackArg = &arg;
-  sd.okCallback = &tempDataOk;
+    case k_linkFu:
+      if (elapsed < AT_CMD_DELAY) {
+        return false;
+      }
+      s_hc12.print(F("AT+B"));
+      s_hc12.print(GH_LINK_BAUD(m_linkTo));
+      m_linkStep = k_linkBaud;
+      break;
 
-  m_tempData.temps[index] = common::k_unknown;
+    case k_linkBaud:
+      if (elapsed < AT_CMD_DELAY) {
+        return false;
+      }
+      sr(IO_PIN_HC12_SET, HIGH);
+      m_linkStep = k_linkSetHigh;
+      break;
 
-  if (send(sd)) {
-    return m_tempData.temps[index];
-  }
-  else {
-    return common::k_unknown;
-  }
-}
+    case k_linkSetHigh:
+      if (elapsed < AT_SET_DELAY) {
+        return false;
+      }
 
-bool Node::MotorRun(MotorDirection direction, byte seconds)
-{
-  if (!keepAlive()) {
-    return false;
+      // drop the module's replies.
+      while (s_hc12.available()) {
+        s_hc12.read();
+      }
+      baud(GH_LINK_BAUD(m_linkTo));
+      m_linkStep = k_linkIdle;
+      return true;
   }
 
-  TRACE_F("Radio sending motor run: direction=%d seconds=%d", direction, seconds);
-  SendDesc sd;
-  sd.to = m_address;
-  sd.cmd = GH_CMD_MOTOR_RUN;
-  sd.data1 = (byte)direction;
-  sd.data2 = seconds;
-  return send(sd);
+  m_linkStepAt = millis();
+  return false;
 }
 
-bool Node::MotorSpeed(byte speed)
-{
-  if (!keepAlive()) {
-    return false;
-  }
-
-  TRACE_F("Radio sending motor speed: speed=%d", speed);
-  SendDesc sd;
-  sd.to = m_address;
-  sd.cmd = GH_CMD_MOTOR_SPEED;
-  sd.data1 = speed;
-  return send(sd);
-}
+#else
 
-bool Node::MotorState(bool &state)
+// without the set pin, the module stays on the robust link (LinkMax
+// should be left there).
+void Radio::Link(uint8_t from, uint8_t to)
 {
-  if (!keepAlive()) {
-    return false;
+  if (to != GH_LINK_ROBUST) {
+    TRACE_F("Error: Radio can't switch to link %d, HC-12 set pin not wired", to);
   }
-
-  TRACE("Radio requesting motor state");
-  SendDesc sd;
-  sd.to = m_address;
-  sd.cmd = GH_CMD_MOTOR_STATE_REQ;
-  sd.expectCmd = GH_CMD_MOTOR_STATE_RSP;
-  if (send(sd)) {
-    state = GH_DATA_1(s_rxBuf);
-    TRACE_F("Radio got motor state, running=%s", BOOL_FS(state));
-    return true;
-  }
-  return false;
 }
 
-} // namespace radio
+bool Radio::LinkDone() { return true; }
 
-// end Node class
+#endif // HC12_SET_EN
 
-// begin free functions
+int Radio::Available() { return s_hc12.available(); }
 
-void printBuffer(const __FlashStringHelper *prompt, const uint8_t *data, uint8_t dataLen)
-{
-#ifdef RADIO_TRACE
-  char printBuf[100];
-  strcpy(printBuf, String(prompt).c_str());
-  int printLen = strlen(printBuf);
-  for (uint8_t i = 0; i < dataLen; i++) {
-    sprintf(printBuf + printLen, "%02Xh", (unsigned int)data[i]);
-    printLen += 2;
-
-    if (i != dataLen - 1) {
-      printBuf[printLen++] = ' ';
-    }
-  }
-  printBuf[printLen] = '\0';
-  TRACE_C(printBuf);
-#endif
-}
+int Radio::Read(uint8_t *buf, int length) { return s_hc12.readBytes(buf, length); }
 
-// end free functions
+void Radio::Write(const uint8_t *buf, int length) { s_hc12.write(buf, length); }
 
 } // namespace greenhouse
 } // namespace embedded
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace native {
+namespace greenhouse {
+
+// the byte stream between the control unit and the nodes (hc-12 on the
+// board, a simulated channel off-target), and the clock it runs on.
+class IRadioTransport {
+public:
+  virtual unsigned long Millis() = 0;
+  virtual int Available() = 0;
+
+  // reads up to length bytes, waiting a short time for them to arrive.
+  virtual int Read(uint8_t *buf, int length) = 0;
+
+  virtual void Write(const uint8_t *buf, int length) = 0;
+
+  // starts switching the local module from one link setting (GH_LINK_)
+  // to another. the module takes at commands at the baud it's on, so from
+  // has to be the setting it has, or the switch is lost. anything on the
+  // air meanwhile is missed.
+  virtual void Link(uint8_t from, uint8_t to) = 0;
+
+  // moves the switch on without blocking; true once it's done. called
+  // from the radio loop until it is.
+  virtual bool LinkDone() = 0;
+};
+
+} // namespace greenhouse
+} // namespace native
@@ -0,0 +1,1565 @@
+#include "NodeRadio.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef RADIO_TRACE
+#define RADIO_TRACE 1
+#endif
+
+#define RX_TIMEOUT 500 // until the node's first rtt sample
+#define TX_RETRY_MAX 5
+#define RTO_MIN 150
+#define RTO_MAX 4000
+#define SEND_QUEUE_MAX 8 // per priority
+#define TEMPS_DEADLINE 10000 // a poll that can't start by then is stale
+#define TEMP_OFFSET -1.2
+#define TEMP_UNKNOWN 255
+#define KEEP_ALIVE_IDLE 60000 // 60s without an exchange
+#define DUTY_CYCLE_MAX 0.1f   // 10%, as for shared 433MHz bands
+#define UART_BITS 10          // start, 8 data, stop
+#define RECONNECT_TIME 10000  // 10s, doubled for each failed hello
+#define RECONNECT_MAX 600000  // 10m
+#define RECONNECT_RETRY_MAX 2 // for a node that has stopped answering
+#define POLL_BACKOFF_MAX 3    // poll interval doubled per failure, up to 8x
+#define TEMP_STALE_INTERVALS 3 // missed pushes before polling
+#define LINK_WINDOW 16         // exchanges to judge a link by
+#define LINK_RETRY_RATIO 4     // step down at more than one retry per this many exchanges
+#define LINK_FAILURES_MAX 3    // exchanges failed in a row before falling back to robust
+#define LINK_STEP_TIME 60000   // 1m on a link before stepping up again
+#define LINK_BACKOFF 600000    // 10m after stepping down or falling back
+#define LINK_KEEP_ALIVE (GH_LINK_FALLBACK / 3)
+
+#if !RADIO_TRACE
+#undef TRACE
+#define TRACE(l)
+#undef TRACE_F
+#define TRACE_F(...)
+#undef TRACE_C
+#define TRACE_C(l)
+#endif // RADIO_TRACE
+
+namespace native {
+namespace greenhouse {
+
+static uint8_t s_rxBuf[GH_LENGTH_MAX];
+static gh_parser s_rxParser;
+
+// the marker goes out in the same write as the frame that follows it.
+static uint8_t s_txStream[GH_SOF_LENGTH + GH_LENGTH_MAX] = { GH_SOF };
+static uint8_t *const s_txBuf = s_txStream + GH_SOF_LENGTH;
+static uint8_t s_txFecStream[GH_SOF_LENGTH + GH_FEC_LENGTH(GH_LENGTH_MAX)] = { GH_SOF_FEC };
+
+void printBuffer(const char *prompt, const uint8_t *data, uint8_t dataLen);
+uint32_t groupBit(uint8_t address);
+
+Radio::Radio() :
+  m_transport(nullptr),
+  m_updateNext(0),
+  m_requests(0),
+  m_errors(0),
+  m_retryMax(TX_RETRY_MAX),
+  m_rtoInitial(RX_TIMEOUT),
+  m_rtoMin(RTO_MIN),
+  m_rtoMax(RTO_MAX),
+  m_keepAliveIdle(KEEP_ALIVE_IDLE),
+  m_groupSequence(GH_SEQ_GROUP | 1),
+  m_link(GH_LINK_ROBUST),
+  m_linkSwitching(false),
+  m_linkSweep(GH_LINK_ROBUST),
+  m_dutyCycleMax(DUTY_CYCLE_MAX)
+{
+}
+
+void Radio::Init(IRadioTransport &transport)
+{
+  TRACE("Radio init");
+  m_transport = &transport;
+  gh_parseInit(&s_rxParser, s_rxBuf);
+
+  // the module keeps its settings over a restart, and only takes at
+  // commands at the baud it's on, which isn't known; Loop tries each
+  // before the first request.
+  m_linkSwitching = false;
+  m_linkSweep = GH_LINK_ROBUST;
+}
+
+radio::Node *Radio::AddNode(uint8_t address, uint8_t caps)
+{
+  if (FindNode(address) != nullptr) {
+    TRACE_F("Error: Radio node already added: %02Xh", address);
+    return nullptr;
+  }
+
+  m_nodes.emplace_back();
+  radio::Node &node = m_nodes.back();
+  node.Init(*this, address, caps);
+  return &node;
+}
+
+void Radio::Loop()
+{
+  startQueued();
+
+  // while switching, what comes in is the module's replies to the at
+  // commands, which the transport drops.
+  while (!m_linkSwitching && Transport().Available()) {
+    receive();
+  }
+
+  for (int i = 0; i < RADIO_IN_FLIGHT_MAX; i++) {
+    radio::InFlight &inFlight = m_inFlight[i];
+    if (inFlight.active && ((Millis() - inFlight.start) >= inFlight.timeout)) {
+      TRACE_F("Error: Radio timeout, to=%02Xh", inFlight.sendDesc.to);
+      m_errors++;
+      count(inFlight.sendDesc, radio::k_statsTimeouts);
+      inFlight.sendDesc.errors++;
+      retry(inFlight);
+    }
+  }
+}
+
+void Radio::Update()
+{
+  // a few nodes per call, taking turns, so each node is seen every
+  // (nodes / RADIO_UPDATE_NODES) calls. background work also waits while
+  // requests are queued, so it doesn't add to the wait for them.
+  if (overDutyCycle()) {
+    return;
+  }
+
+  const int nodes = (NodeCount() < RADIO_UPDATE_NODES) ? NodeCount() : RADIO_UPDATE_NODES;
+  for (int i = 0; i < nodes; i++) {
+    if (Queued() >= RADIO_UPDATE_QUEUE_MAX) {
+      return;
+    }
+
+    m_nodes[m_updateNext].Update();
+    m_updateNext = (m_updateNext + 1) % NodeCount();
+  }
+}
+
+radio::Node &Radio::Node(int index)
+{
+  if (index < 0 || index >= NodeCount()) {
+    TRACE_F("Fatal: Radio node out of bounds, index=%d", (int)index);
+    common::halt();
+  }
+  return m_nodes[index];
+}
+
+bool Radio::Send(radio::SendDesc &sendDesc)
+{
+  // a queue per priority, so polls can't fill it up for actuation.
+  std::deque<radio::SendDesc> &queue = m_sendQueue[sendDesc.priority];
+  if (queue.size() >= SEND_QUEUE_MAX) {
+    TRACE_F(
+      "Error: Radio send queue full, to=%02Xh, cmd=%02Xh, priority=%d",
+      sendDesc.to,
+      sendDesc.cmd,
+      sendDesc.priority);
+    m_errors++;
+    return false;
+  }
+
+  sendDesc.queued = Millis();
+  queue.push_back(sendDesc);
+  TRACE_F("Radio send queued, priority=%d, queue=%d", sendDesc.priority, (int)queue.size());
+  return true;
+}
+
+int Radio::Queued() const
+{
+  int queued = 0;
+  for (int i = 0; i < radio::k_priorityCount; i++) {
+    queued += (int)m_sendQueue[i].size();
+  }
+  return queued;
+}
+
+radio::Node *Radio::FindNode(uint8_t address)
+{
+  for (int i = 0; i < NodeCount(); i++) {
+    if (m_nodes[i].Address() == address) {
+      return &m_nodes[i];
+    }
+  }
+  return nullptr;
+}
+
+radio::InFlight *Radio::findInFlight(uint8_t address)
+{
+  for (int i = 0; i < RADIO_IN_FLIGHT_MAX; i++) {
+    if (m_inFlight[i].active && (m_inFlight[i].sendDesc.to == address)) {
+      return &m_inFlight[i];
+    }
+  }
+  return nullptr;
+}
+
+radio::InFlight *Radio::findGroupInFlight(uint8_t seq)
+{
+  for (int i = 0; i < RADIO_IN_FLIGHT_MAX; i++) {
+    radio::SendDesc &sendDesc = m_inFlight[i].sendDesc;
+    if (m_inFlight[i].active && GH_ADDR_IS_GROUP(sendDesc.to) && (sendDesc.seq == seq)) {
+      return &m_inFlight[i];
+    }
+  }
+  return nullptr;
+}
+
+bool Radio::inFlight() const
+{
+  for (int i = 0; i < RADIO_IN_FLIGHT_MAX; i++) {
+    if (m_inFlight[i].active) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Radio::overDutyCycle() { return Utilisation() > m_dutyCycleMax; }
+
+radio::InFlight *Radio::freeInFlight(radio::SendPriority priority)
+{
+  int active = 0;
+  for (int i = 0; i < RADIO_IN_FLIGHT_MAX; i++) {
+    if (m_inFlight[i].active) {
+      active++;
+    }
+  }
+  const int shared = RADIO_IN_FLIGHT_MAX - RADIO_IN_FLIGHT_RESERVED;
+  if ((priority >= radio::k_priorityTelemetry) && (active >= shared)) {
+    return nullptr;
+  }
+
+  for (int i = 0; i < RADIO_IN_FLIGHT_MAX; i++) {
+    if (!m_inFlight[i].active) {
+      return &m_inFlight[i];
+    }
+  }
+  return nullptr;
+}
+
+void Radio::startQueued()
+{
+  dropExpired();
+  if (!linkReady()) {
+    return;
+  }
+
+  // start the oldest request for each idle node, highest priority first;
+  // requests for a node that already has one in flight keep their place
+  // in the queue.
+  for (int priority = 0; priority < radio::k_priorityCount; priority++) {
+    if ((priority >= radio::k_priorityTelemetry) && overDutyCycle()) {
+      return;
+    }
+
+    std::deque<radio::SendDesc> &queue = m_sendQueue[priority];
+    for (auto it = queue.begin(); it != queue.end();) {
+      if (findInFlight(it->to) != nullptr) {
+        ++it;
+        continue;
+      }
+
+      // there's one module, so a request on another link waits until
+      // nothing is in flight. later requests wait behind it, so it isn't
+      // held off for good by a busy link.
+      const uint8_t next = link(*it);
+      if (next != m_link) {
+        if (this->inFlight()) {
+          return;
+        }
+
+        TRACE_F("Radio switching link: %d -> %d", m_link, next);
+        switchLink(m_link, next);
+        m_link = next;
+        return;
+      }
+
+      radio::InFlight *inFlight = freeInFlight((radio::SendPriority)priority);
+      if (inFlight == nullptr) {
+        return;
+      }
+
+      inFlight->active = true;
+      inFlight->sendDesc = *it;
+      inFlight->attempt = 0;
+      it = queue.erase(it);
+
+      transmit(*inFlight);
+    }
+  }
+}
+
+// true once the module is on m_link and nothing's left of the boot sweep.
+bool Radio::linkReady()
+{
+  if (m_linkSwitching) {
+    if (!Transport().LinkDone()) {
+      return false;
+    }
+    m_linkSwitching = false;
+  }
+
+  if (m_linkSweep <= GH_LINK_MAX) {
+    switchLink(m_linkSweep++, m_link);
+    return false;
+  }
+  return true;
+}
+
+void Radio::switchLink(uint8_t from, uint8_t to)
+{
+  Transport().Link(from, to);
+  m_linkSwitching = true;
+}
+
+void Radio::dropExpired()
+{
+  // taken out of the queue before the callbacks run, since they may
+  // queue more.
+  std::deque<radio::SendDesc> expired;
+  for (int priority = 0; priority < radio::k_priorityCount; priority++) {
+    std::deque<radio::SendDesc> &queue = m_sendQueue[priority];
+    for (auto it = queue.begin(); it != queue.end();) {
+      if ((it->deadline != 0) && ((Millis() - it->queued) > it->deadline)) {
+        expired.push_back(*it);
+        it = queue.erase(it);
+      }
+      else {
+        ++it;
+      }
+    }
+  }
+
+  // not sent, so nothing is known about the node; only the caller hears.
+  for (radio::SendDesc &sendDesc : expired) {
+    TRACE_F(
+      "Error: Radio request expired in queue, to=%02Xh, cmd=%02Xh",
+      sendDesc.to,
+      sendDesc.cmd);
+    m_errors++;
+    count(sendDesc, radio::k_statsExpired);
+    if (sendDesc.doneCallback != NULL) {
+      sendDesc.doneCallback(sendDesc, false);
+    }
+  }
+}
+
+void Radio::transmit(radio::InFlight &inFlight)
+{
+  radio::SendDesc &sendDesc = inFlight.sendDesc;
+
+  TRACE_F(
+    "Radio sending, attempt=%d, to=%02Xh, cmd=%02Xh, seq=%d",
+    inFlight.attempt + 1,
+    sendDesc.to,
+    sendDesc.cmd,
+    sendDesc.seq);
+
+  GH_LEN(s_txBuf) = GH_PAYLOAD_DEFAULT;
+  GH_TO(s_txBuf) = sendDesc.to;
+  GH_FROM(s_txBuf) = GH_ADDR_MAIN;
+  GH_CMD(s_txBuf) = sendDesc.cmd;
+  GH_DATA_1(s_txBuf) = sendDesc.data1;
+  GH_DATA_2(s_txBuf) = sendDesc.data2;
+
+  if (sendDesc.cmd == GH_CMD_BATCH) {
+    GH_LEN(s_txBuf) = GH_BATCH_LENGTH(sendDesc.batchCount);
+    GH_DATA_1(s_txBuf) = sendDesc.batchCount;
+    memcpy(
+      &GH_BATCH_ENTRY(s_txBuf, 0, 0),
+      sendDesc.batch,
+      sendDesc.batchCount * GH_BATCH_ENTRY_LENGTH);
+  }
+
+  GH_SEQ(s_txBuf) = sendDesc.seq;
+  sendDesc.attempts = inFlight.attempt + 1;
+
+  gh_crcWrite(s_txBuf);
+
+  m_requests++;
+  count(sendDesc, radio::k_statsAttempts);
+
+  // no need to clear the rx buffer first; anything stale or out of step
+  // is skipped by the parser.
+  const int length = GH_FRAME_LENGTH(s_txBuf);
+  int streamLength;
+  if (fec(sendDesc)) {
+    for (int i = 0; i < length; i++) {
+      gh_fecEncodeByte(s_txBuf[i], &s_txFecStream[GH_SOF_LENGTH + GH_FEC_LENGTH(i)]);
+    }
+    streamLength = GH_SOF_LENGTH + GH_FEC_LENGTH(length);
+    Transport().Write(s_txFecStream, streamLength);
+  }
+  else {
+    streamLength = GH_SOF_LENGTH + length;
+    Transport().Write(s_txStream, streamLength);
+  }
+
+  // the module sends as fast as the uart feeds it, so the uart time is
+  // close to the time on air (give or take the preamble).
+  m_airtime.Add(Millis(), (streamLength * UART_BITS * 1000000UL) / GH_LINK_BAUD(m_link));
+
+  inFlight.start = Millis();
+
+  printBuffer("Radio sent data: ", s_txBuf, GH_FRAME_LENGTH(s_txBuf));
+
+  // timeout is based on how quickly this node usually responds, doubled
+  // on each retry; 433MHz is a very busy frequency, and we don't want to
+  // fight with another retry loop.
+  inFlight.timeout = rto(sendDesc) << inFlight.attempt;
+  if (inFlight.timeout > m_rtoMax) {
+    inFlight.timeout = m_rtoMax;
+  }
+  TRACE_F("Radio waiting for response, timeout: %lums", inFlight.timeout);
+}
+
+bool Radio::fec(const radio::SendDesc &sendDesc)
+{
+  if (sendDesc.node != nullptr) {
+    return sendDesc.node->Fec();
+  }
+
+  // any member that needs it; the others can decode it too.
+  for (int i = 0; i < NodeCount(); i++) {
+    if ((sendDesc.groupMask & groupBit(m_nodes[i].Address())) && m_nodes[i].Fec()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint8_t Radio::link(const radio::SendDesc &sendDesc)
+{
+  if (sendDesc.node != nullptr) {
+    return sendDesc.node->Link();
+  }
+
+  // members on a faster link than the slowest miss it, and the send
+  // fails as it would for a lost ack.
+  uint8_t link = GH_LINK_MAX;
+  for (int i = 0; i < NodeCount(); i++) {
+    if ((sendDesc.groupMask & groupBit(m_nodes[i].Address())) && (m_nodes[i].Link() < link)) {
+      link = m_nodes[i].Link();
+    }
+  }
+  return link;
+}
+
+unsigned long Radio::rto(const radio::SendDesc &sendDesc)
+{
+  if (sendDesc.node != nullptr) {
+    return sendDesc.node->Rto();
+  }
+
+  if (sendDesc.groupMask == 0) {
+    return m_rtoInitial;
+  }
+
+  // wait for the slowest member yet to ack, plus the ack slots before it.
+  unsigned long rto = 0;
+  int slots = 0;
+  for (int i = 0; i < NodeCount(); i++) {
+    radio::Node &node = m_nodes[i];
+    if (!(sendDesc.groupMask & groupBit(node.Address()))) {
+      continue;
+    }
+    if (node.Rto() > rto) {
+      rto = node.Rto();
+    }
+    if (GH_NODE_INDEX(node.Address()) >= slots) {
+      slots = GH_NODE_INDEX(node.Address()) + 1;
+    }
+  }
+  return rto + (GH_GROUP_ACK_SLOT * slots);
+}
+
+void Radio::receive()
+{
+  // a byte at a time, so a stray or lost byte only costs the frame it's in
+  // (if that); the parser picks up again at the next marker.
+  uint8_t b;
+  if (Transport().Read(&b, 1) != 1) {
+    return;
+  }
+
+  // the frame's header is still in the buffer if it was read before the
+  // frame was dropped.
+  const bool header = (s_rxParser.length >= GH_HEADER_LENGTH);
+  const uint8_t result = gh_parse(&s_rxParser, b);
+  if (result == GH_PARSE_DROPPED) {
+    TRACE("Error: Radio frame corrupt (CRC mismatch or bytes lost)");
+    m_errors++;
+
+    // retry right away only if it's the response to a request in flight
+    // (noise or another node's traffic isn't); otherwise leave it to the
+    // timeout, as is background traffic over the duty cycle.
+    radio::InFlight *inFlight = nullptr;
+    if (header && (GH_TO(s_rxBuf) == GH_ADDR_MAIN)) {
+      inFlight = findInFlight(GH_FROM(s_rxBuf));
+    }
+    if ((inFlight != nullptr) && (GH_SEQ(s_rxBuf) == inFlight->sendDesc.seq)) {
+      count(inFlight->sendDesc, radio::k_statsCorrupt);
+      inFlight->sendDesc.errors++;
+      if ((inFlight->sendDesc.priority < radio::k_priorityTelemetry) || !overDutyCycle()) {
+        retry(*inFlight);
+      }
+    }
+    return;
+  }
+
+  if (result != GH_PARSE_FRAME) {
+    return;
+  }
+
+  printBuffer("Radio got data: ", s_rxBuf, s_rxParser.length);
+
+  if (s_rxParser.corrected != 0) {
+    TRACE_F("Radio corrected %d bit errors", s_rxParser.corrected);
+    radio::Node *from = FindNode(GH_FROM(s_rxBuf));
+    if (from != nullptr) {
+      from->Stats().fecCorrected += s_rxParser.corrected;
+    }
+  }
+
+  // unsolicited, so there's no request to match it to.
+  if ((GH_TO(s_rxBuf) == GH_ADDR_MAIN) && (GH_CMD(s_rxBuf) == GH_CMD_TEMP_PUSH)) {
+    radio::Node *node = FindNode(GH_FROM(s_rxBuf));
+    if (node != nullptr) {
+      node->OnTempPush();
+    }
+    return;
+  }
+
+  radio::InFlight *inFlight = nullptr;
+  if (GH_TO(s_rxBuf) == GH_ADDR_MAIN) {
+    // a member's ack for a group request; never the reply to its own.
+    if (GH_SEQ(s_rxBuf) & GH_SEQ_GROUP) {
+      radio::InFlight *group = findGroupInFlight(GH_SEQ(s_rxBuf));
+      if (group != nullptr) {
+        handleGroupAck(*group);
+      }
+      else {
+        TRACE_F("Radio ignoring stale group ack, from=%02Xh", GH_FROM(s_rxBuf));
+      }
+      return;
+    }
+    inFlight = findInFlight(GH_FROM(s_rxBuf));
+  }
+
+  if (inFlight == nullptr) {
+    TRACE("Radio ignoring message (address mismatch)");
+    // don't report an error, this is fine
+    return;
+  }
+
+  if (GH_SEQ(s_rxBuf) != inFlight->sendDesc.seq) {
+    // a late response to an earlier request that has already finished.
+    TRACE_F(
+      "Radio ignoring stale response, from=%02Xh, seq: %d!=%d",
+      GH_FROM(s_rxBuf),
+      GH_SEQ(s_rxBuf),
+      inFlight->sendDesc.seq);
+    return;
+  }
+
+  const unsigned long rtt = Millis() - inFlight->start;
+  TRACE_F("Radio response time: %lums", rtt);
+  if (inFlight->sendDesc.node != nullptr) {
+    inFlight->sendDesc.node->Stats().rtt.Add(rtt);
+  }
+
+  // only sample the first attempt; after a retry, we can't tell which
+  // attempt the response is for (karn's algorithm).
+  if ((inFlight->attempt == 0) && (inFlight->sendDesc.node != nullptr)) {
+    inFlight->sendDesc.node->OnRttSample(rtt);
+  }
+
+  complete(*inFlight, handleResponse(*inFlight));
+}
+
+bool batchRspOk(const radio::SendDesc &sendDesc)
+{
+  const uint8_t count = GH_DATA_1(s_rxBuf);
+  if ((count != sendDesc.batchCount) || (GH_LEN(s_rxBuf) != GH_BATCH_LENGTH(count))) {
+    TRACE_F("Error: Radio batch response count invalid: %d!=%d", count, sendDesc.batchCount);
+    return false;
+  }
+
+  bool ok = true;
+  for (int i = 0; i < count; i++) {
+    if (GH_BATCH_ENTRY(s_rxBuf, i, 0) == GH_CMD_ERROR) {
+      TRACE_F(
+        "Error: Radio batch entry %d (cmd=%02Xh) failed, code: %d",
+        i,
+        sendDesc.batch[i][0],
+        GH_BATCH_ENTRY(s_rxBuf, i, 1));
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+// the node replays the same reply for a retry, so a bad one fails the
+// send straight away; sending it again under a new sequence could run
+// the parts that did work twice.
+bool Radio::handleResponse(radio::InFlight &inFlight)
+{
+  radio::SendDesc &sendDesc = inFlight.sendDesc;
+  bool ok = true;
+
+  if (GH_CMD(s_rxBuf) == GH_CMD_ERROR) {
+    TRACE_F("Error: Code from node %02Xh: %d", sendDesc.to, GH_DATA_1(s_rxBuf));
+    ok = false;
+  }
+  else if (GH_CMD(s_rxBuf) != sendDesc.expectCmd) {
+    TRACE("Error: Radio got unexpected command");
+    ok = false;
+  }
+  else if ((sendDesc.cmd == GH_CMD_BATCH) && !batchRspOk(sendDesc)) {
+    ok = false;
+  }
+  else if (sendDesc.okCallback != NULL) {
+    sendDesc.okCallbackResult = sendDesc.okCallback(sendDesc);
+    if (!sendDesc.okCallbackResult) {
+      TRACE("Error: Radio OK callback failed");
+      ok = false;
+    }
+  }
+
+  if (ok) {
+    return true;
+  }
+
+  m_errors++;
+  sendDesc.errors++;
+  sendDesc.rejected = true;
+  count(sendDesc, radio::k_statsUnexpected);
+  return false;
+}
+
+void Radio::handleGroupAck(radio::InFlight &inFlight)
+{
+  radio::SendDesc &sendDesc = inFlight.sendDesc;
+  const uint8_t from = GH_FROM(s_rxBuf);
+  const uint32_t bit = groupBit(from);
+
+  radio::Node *node = FindNode(from);
+  if ((node == nullptr) || !(sendDesc.groupMask & bit)) {
+    // an ack for an earlier attempt that we already have.
+    TRACE_F("Radio ignoring group ack, from=%02Xh", from);
+    return;
+  }
+
+  if (GH_CMD(s_rxBuf) != sendDesc.expectCmd) {
+    TRACE_F("Error: Radio group member %02Xh replied with command %02Xh", from, GH_CMD(s_rxBuf));
+    m_errors++;
+    sendDesc.errors++;
+    node->Stats().counts[radio::statsCmd(sendDesc.cmd)][radio::k_statsUnexpected]++;
+    return;
+  }
+
+  TRACE_F("Radio got group ack from %02Xh", from);
+  node->Stats().counts[radio::statsCmd(sendDesc.cmd)][radio::k_statsOk]++;
+  sendDesc.groupMask &= ~bit;
+  if (sendDesc.groupMask == 0) {
+    complete(inFlight, true);
+  }
+}
+
+void Radio::count(const radio::SendDesc &sendDesc, radio::StatsCounter counter)
+{
+  const radio::StatsCmd cmd = radio::statsCmd(sendDesc.cmd);
+  if (sendDesc.node != nullptr) {
+    sendDesc.node->Stats().counts[cmd][counter]++;
+    return;
+  }
+
+  // group; every member that hasn't acked yet.
+  for (int i = 0; i < NodeCount(); i++) {
+    if (sendDesc.groupMask & groupBit(m_nodes[i].Address())) {
+      m_nodes[i].Stats().counts[cmd][counter]++;
+    }
+  }
+}
+
+void Radio::retry(radio::InFlight &inFlight)
+{
+  const int retryMax = (inFlight.sendDesc.retryMax != 0) ? inFlight.sendDesc.retryMax : m_retryMax;
+  if (++inFlight.attempt < retryMax) {
+    transmit(inFlight);
+  }
+  else {
+    complete(inFlight, false);
+  }
+}
+
+void Radio::complete(radio::InFlight &inFlight, bool rx)
+{
+  TRACE_F(
+    "Radio stats, rx=%s, errors={now: %d, total: %d}, requests=%d",
+    BOOL_FS(rx),
+    inFlight.sendDesc.errors,
+    m_errors,
+    m_requests);
+
+  // group members count as ok as they ack, so only failures are left.
+  if ((inFlight.sendDesc.node != nullptr) || !rx) {
+    count(inFlight.sendDesc, rx ? radio::k_statsOk : radio::k_statsFailed);
+  }
+
+  // free up the slot before the callback, which may queue another send.
+  radio::SendDesc sendDesc = inFlight.sendDesc;
+  inFlight.active = false;
+
+  if (sendDesc.node != nullptr) {
+    sendDesc.node->OnSendDone(sendDesc, rx);
+  }
+  else if (sendDesc.doneCallback != NULL) {
+    sendDesc.doneCallback(sendDesc, rx);
+  }
+}
+
+void motorRunAllDone(radio::SendDesc &sendDesc, bool ok)
+{
+  (void)sendDesc; // only traced
+  if (!ok) {
+    TRACE_F(
+      "Error: Radio motor run not acked by all windows, missing=%02Xh",
+      sendDesc.groupMask);
+  }
+}
+
+void Radio::MotorRunAll(
+  radio::MotorDirection direction,
+  uint8_t seconds,
+  radio::SendPriority priority)
+{
+  // one frame starts every window motor at the same time; each node acks
+  // in its own slot, and a node with its motor still running queues it.
+  radio::SendDesc sd;
+  sd.to = GH_ADDR_WINDOWS;
+  sd.cmd = GH_CMD_MOTOR_RUN;
+  sd.data1 = (uint8_t)direction;
+  sd.data2 = seconds;
+  sd.seq = m_groupSequence;
+  m_groupSequence = GH_SEQ_NEXT(m_groupSequence);
+  sd.priority = priority;
+  sd.doneCallback = &motorRunAllDone;
+  bool mixed = false;
+  for (int i = 0; i < NodeCount(); i++) {
+    if (m_nodes[i].Has(radio::k_capMotor)) {
+      mixed = mixed || ((sd.groupMask != 0) && (m_nodes[i].Link() != link(sd)));
+      sd.groupMask |= groupBit(m_nodes[i].Address());
+    }
+  }
+
+  if (sd.groupMask == 0) {
+    TRACE("Error: Radio has no window nodes for motor run");
+    return;
+  }
+
+  // windows on different links can't hear the same frame, so each gets
+  // its own.
+  if (mixed) {
+    TRACE("Radio windows on mixed links, sending motor run to each");
+    for (int i = 0; i < NodeCount(); i++) {
+      if (m_nodes[i].Has(radio::k_capMotor)) {
+        m_nodes[i].MotorRun(direction, seconds, priority);
+      }
+    }
+    return;
+  }
+
+  TRACE_F("Radio sending motor run to windows: direction=%d seconds=%d", direction, seconds);
+  if (!Send(sd)) {
+    TRACE("Error: Radio motor run not started");
+  }
+}
+
+// begin node class
+
+namespace radio {
+
+bool batchAdd(SendDesc &sendDesc, uint8_t cmd, uint8_t data1, uint8_t data2)
+{
+  if (sendDesc.batchCount >= GH_BATCH_MAX) {
+    TRACE_F("Error: Radio batch full, to=%02Xh, cmd=%02Xh", sendDesc.to, cmd);
+    return false;
+  }
+
+  uint8_t *entry = sendDesc.batch[sendDesc.batchCount++];
+  entry[0] = cmd;
+  entry[1] = data1;
+  entry[2] = data2;
+  sendDesc.cmd = GH_CMD_BATCH;
+  sendDesc.expectCmd = GH_CMD_BATCH_RSP;
+  return true;
+}
+
+bool batchHas(const SendDesc &sendDesc, uint8_t cmd, uint8_t data1, uint8_t data2)
+{
+  for (int i = 0; i < sendDesc.batchCount; i++) {
+    const uint8_t *entry = sendDesc.batch[i];
+    if ((entry[0] == cmd) && (entry[1] == data1) && (entry[2] == data2)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+Node::Node() :
+  m_init(false),
+  m_radio(nullptr),
+  m_tempDataOk(false),
+  m_tempsPending(false),
+  m_tempDataTime(common::k_unknownUL),
+  m_tempSubInterval(0),
+  m_tempSubDelta(0),
+  m_tempSubPending(false),
+  m_tempResolution(0),
+  m_tempStatsOk(false),
+  m_tempStatsPending(false),
+  m_motorSpeed(0),
+  m_motorSpeedSet(false),
+  m_tempPollNext(common::k_unknownUL),
+  m_address(UNKNOWN_ADDRESS),
+  m_caps(0),
+  m_fec(false),
+  m_link(GH_LINK_ROBUST),
+  m_linkMax(GH_LINK_ROBUST),
+  m_linkPending(false),
+  m_linkNext(0),
+  m_linkExchanges(0),
+  m_linkRetries(0),
+  m_helloOk(false),
+  m_helloPending(false),
+  m_keepAliveExpiry(common::k_unknownUL),
+  m_nextReconnect(common::k_unknownUL),
+  m_reconnectDelay(RECONNECT_TIME),
+  m_failures(0),
+  m_random(0),
+  m_sequence(1),
+  m_errors(0),
+  m_srtt(common::k_unknownUL),
+  m_rttVar(0),
+  m_rto(RX_TIMEOUT)
+{
+  m_tempData.devs = 0;
+}
+
+void Node::Init(native::greenhouse::Radio &radio, uint8_t address, uint8_t caps)
+{
+  TRACE_F("Init radio node, address=%02Xh, caps=%02Xh", address, caps);
+  m_radio = &radio;
+  m_address = address;
+  m_caps = caps;
+  m_rto = radio.RtoInitial();
+  m_random = 0x9E3779B9UL ^ address;
+  hello();
+  m_init = true;
+}
+
+void Node::Update()
+{
+  if (!m_init) {
+    return;
+  }
+
+  if (m_helloOk) {
+    keepAlive();
+    updateLink();
+  }
+  else if (!m_helloPending && (now() > m_nextReconnect)) {
+    TRACE_F("Reconnecting to node: %02Xh", m_address);
+    hello();
+  }
+
+  updateTempSub();
+}
+
+bool Node::Online() { return m_helloOk && !keepAliveExpired(); }
+
+void Node::stepSequence() { m_sequence = GH_SEQ_NEXT(m_sequence); }
+
+unsigned long Node::now() const { return Radio().Millis(); }
+
+bool Node::keepAliveExpired() { return now() > m_keepAliveExpiry; }
+
+void Node::renewKeepAlive()
+{
+  // off the robust link, the node falls back if it doesn't hear from us.
+  const unsigned long idle = (m_link != GH_LINK_ROBUST) ? LINK_KEEP_ALIVE : Radio().KeepAliveIdle();
+  m_keepAliveExpiry = now() + idle;
+}
+
+void Node::scheduleReconnect()
+{
+  // half the delay plus up to half again at random, so nodes that
+  // dropped out together don't all come back in the same moment.
+  m_random ^= m_random << 13;
+  m_random ^= m_random >> 17;
+  m_random ^= m_random << 5;
+  const unsigned long half = m_reconnectDelay / 2;
+  m_nextReconnect = now() + half + (m_random % (half + 1));
+
+  m_reconnectDelay *= 2;
+  if (m_reconnectDelay > RECONNECT_MAX) {
+    m_reconnectDelay = RECONNECT_MAX;
+  }
+  TRACE_F("Radio reconnecting to node %02Xh in %lums", m_address, m_nextReconnect - now());
+}
+
+bool Node::keepAlive()
+{
+  if (keepAliveExpired() && !m_helloPending) {
+    TRACE_F("Radio link idle, saying hello to node: %02Xh", m_address);
+    hello();
+  }
+  return m_helloOk;
+}
+
+bool helloOk(SendDesc &sendDesc)
+{
+  const uint8_t rxSeq = GH_SEQ(s_rxBuf);
+  if (rxSeq != sendDesc.seq) {
+    TRACE_F("Error: Radio ack invalid, sequence: %d!=%d", rxSeq, sendDesc.seq);
+    return false;
+  }
+
+  return true;
+}
+
+bool Node::Send(radio::SendDesc &sendDesc)
+{
+  sendDesc.seq = m_sequence;
+  sendDesc.node = this;
+  if (!Radio().Send(sendDesc)) {
+    return false;
+  }
+  stepSequence();
+  return true;
+}
+
+void Node::OnSendDone(SendDesc &sendDesc, bool ok)
+{
+  m_errors += sendDesc.errors;
+  TRACE_F("Total errors for node %02Xh: %d", m_address, m_errors);
+
+  // any answer shows the node is there, so hello is only needed once the
+  // link has been idle.
+  if (ok || sendDesc.rejected) {
+    renewKeepAlive();
+    m_failures = 0;
+  }
+  else {
+    m_failures++;
+  }
+
+  if (sendDesc.doneCallback != NULL) {
+    sendDesc.doneCallback(sendDesc, ok);
+  }
+
+  linkSample(sendDesc, ok);
+}
+
+void Node::OnRttSample(unsigned long rtt)
+{
+  // smoothed rtt and variance, as with tcp (rfc 6298):
+  // srtt += (rtt - srtt) / 8, rttvar += (|rtt - srtt| - rttvar) / 4
+  if (m_srtt == common::k_unknownUL) {
+    m_srtt = rtt;
+    m_rttVar = rtt / 2;
+  }
+  else {
+    const unsigned long delta = (rtt > m_srtt) ? (rtt - m_srtt) : (m_srtt - rtt);
+    m_rttVar = (m_rttVar * 3 + delta) / 4;
+    m_srtt = (m_srtt * 7 + rtt) / 8;
+  }
+
+  m_rto = m_srtt + (m_rttVar * 4);
+  if (m_rto < Radio().RtoMin()) {
+    m_rto = Radio().RtoMin();
+  }
+  else if (m_rto > Radio().RtoMax()) {
+    m_rto = Radio().RtoMax();
+  }
+
+  TRACE_F(
+    "Radio node %02Xh rtt=%lums, srtt=%lums, rttvar=%lums, rto=%lums",
+    m_address,
+    rtt,
+    m_srtt,
+    m_rttVar,
+    m_rto);
+}
+
+bool Node::hello()
+{
+  if (m_helloPending) {
+    return true;
+  }
+
+  TRACE_F("Radio saying hello to %02Xh", m_address);
+
+  SendDesc sd;
+  sd.to = m_address;
+  sd.cmd = GH_CMD_HELLO;
+  sd.priority = k_priorityHousekeeping;
+  sd.okCallback = &helloOk;
+  sd.doneCallback = &helloDone;
+
+  // a node that has stopped answering gets a short try; it's tried
+  // again later anyway, and its retries hold up the other nodes.
+  if (m_failures != 0) {
+    sd.retryMax = RECONNECT_RETRY_MAX;
+  }
+
+  // the node forgets its settings if it restarts, so send them with the
+  // hello rather than in an exchange each.
+  if ((m_tempSubInterval != 0) || (m_tempResolution != 0) || m_motorSpeedSet) {
+    batchAdd(sd, GH_CMD_HELLO);
+    if (m_tempSubInterval != 0) {
+      batchAdd(sd, GH_CMD_TEMP_SUB, m_tempSubInterval, m_tempSubDelta);
+    }
+    if (m_tempResolution != 0) {
+      batchAdd(sd, GH_CMD_TEMP_RES, m_tempResolution);
+    }
+    if (m_motorSpeedSet) {
+      batchAdd(sd, GH_CMD_MOTOR_SPEED, m_motorSpeed);
+    }
+  }
+
+  m_helloPending = Send(sd);
+  if (!m_helloPending) {
+    m_helloOk = false;
+    m_nextReconnect = now() + RECONNECT_TIME;
+  }
+
+  return m_helloPending;
+}
+
+void Node::helloDone(SendDesc &sendDesc, bool ok)
+{
+  Node &node = *sendDesc.node;
+  node.m_helloPending = false;
+  node.m_helloOk = ok && sendDesc.okCallbackResult;
+
+  if (node.m_helloOk) {
+    TRACE_F("Radio node online: %02Xh", node.m_address);
+    node.m_reconnectDelay = RECONNECT_TIME;
+
+    // settings that changed while the hello was in flight.
+    if ((node.m_tempSubInterval != 0) &&
+        !batchHas(sendDesc, GH_CMD_TEMP_SUB, node.m_tempSubInterval, node.m_tempSubDelta)) {
+      node.sendTempSub();
+    }
+    if ((node.m_tempResolution != 0) &&
+        !batchHas(sendDesc, GH_CMD_TEMP_RES, node.m_tempResolution)) {
+      node.sendTempResolution();
+    }
+    if (node.m_motorSpeedSet && !batchHas(sendDesc, GH_CMD_MOTOR_SPEED, node.m_motorSpeed)) {
+      node.sendMotorSpeed();
+    }
+  }
+  else {
+    node.scheduleReconnect();
+    TRACE_F(
+      "Error: Radio hello failed, node offline: %02Xh, rx=%s, ack=%s",
+      node.m_address,
+      BOOL_FS(ok),
+      BOOL_FS(sendDesc.okCallbackResult));
+  }
+}
+
+float tempFromRaw(uint8_t a, uint8_t b)
+{
+  if (b == TEMP_UNKNOWN) {
+    return common::k_unknown;
+  }
+  return b * 16.0 + a / 16.0;
+}
+
+bool parseTemps(radio::TempData *data)
+{
+  const int devs = GH_DATA_1(s_rxBuf);
+  if ((devs > TEMP_DEVS_MAX) || (GH_LEN(s_rxBuf) < GH_TEMP_ALL_LENGTH(devs))) {
+    TRACE_F("Error: Radio temperature device count invalid: %d", devs);
+    return false;
+  }
+
+  data->devs = devs;
+  for (int i = 0; i < devs; i++) {
+    const uint8_t a = GH_TEMP_ALL_DATA(s_rxBuf, i, 0);
+    const uint8_t b = GH_TEMP_ALL_DATA(s_rxBuf, i, 1);
+    data->temps[i] = tempFromRaw(a, b);
+  }
+
+  TRACE_F("Got all temperature data, devices=%d", devs);
+  return true;
+}
+
+bool tempAllOk(SendDesc &sendDesc)
+{
+  return parseTemps((radio::TempData *)sendDesc.okCallbackArg);
+}
+
+bool Node::RequestTemps()
+{
+  if (!keepAlive()) {
+    return false;
+  }
+
+  if (m_tempsPending) {
+    TRACE_F("Radio temperature request already pending for node: %02Xh", m_address);
+    return true;
+  }
+
+  TRACE("Requesting temperature values from all devices");
+
+  SendDesc sd;
+  sd.to = m_address;
+  sd.cmd = GH_CMD_TEMP_ALL_REQ;
+  sd.expectCmd = GH_CMD_TEMP_ALL_RSP;
+  sd.priority = k_priorityTelemetry;
+  sd.deadline = TEMPS_DEADLINE;
+  sd.okCallback = &tempAllOk;
+  sd.okCallbackArg = &m_tempData;
+  sd.doneCallback = &tempsDone;
+
+  m_tempsPending = Send(sd);
+  return m_tempsPending;
+}
+
+void Node::tempsDone(SendDesc &sendDesc, bool ok)
+{
+  Node &node = *sendDesc.node;
+  node.m_tempsPending = false;
+  node.m_tempDataOk = ok;
+  if (ok) {
+    node.m_tempDataTime = node.now();
+  }
+}
+
+float tempFromStats(uint8_t dev, uint8_t part)
+{
+  return tempFromRaw(
+    GH_TEMP_STATS_DATA(s_rxBuf, dev, part),
+    GH_TEMP_STATS_DATA(s_rxBuf, dev, part + 1));
+}
+
+bool tempStatsOk(SendDesc &sendDesc)
+{
+  const int devs = GH_DATA_1(s_rxBuf);
+  if ((devs > TEMP_DEVS_MAX) || (GH_LEN(s_rxBuf) < GH_TEMP_STATS_LENGTH(devs))) {
+    TRACE_F("Error: Radio temperature device count invalid: %d", devs);
+    return false;
+  }
+
+  radio::TempStatsData *data = (radio::TempStatsData *)sendDesc.okCallbackArg;
+  data->devs = devs;
+  for (int i = 0; i < devs; i++) {
+    radio::TempStat &stat = data->stats[i];
+    stat.min = tempFromStats(i, GH_TEMP_STATS_MIN);
+    stat.max = tempFromStats(i, GH_TEMP_STATS_MAX);
+    stat.mean = tempFromStats(i, GH_TEMP_STATS_MEAN);
+    stat.age = GH_TEMP_STATS_DATA(s_rxBuf, i, GH_TEMP_STATS_AGE);
+    TRACE_F(
+      "Temperature stats, device=%d: min=%.2f max=%.2f mean=%.2f age=%ds",
+      i,
+      stat.min,
+      stat.max,
+      stat.mean,
+      stat.age);
+  }
+  return true;
+}
+
+// the node keeps its last few reads of each device, so one exchange shows
+// any excursion since the last poll.
+bool Node::RequestTempStats()
+{
+  if (!keepAlive()) {
+    return false;
+  }
+
+  if (m_tempStatsPending) {
+    TRACE_F("Radio temperature stats request already pending for node: %02Xh", m_address);
+    return true;
+  }
+
+  TRACE("Requesting temperature stats from all devices");
+
+  SendDesc sd;
+  sd.to = m_address;
+  sd.cmd = GH_CMD_TEMP_STATS_REQ;
+  sd.expectCmd = GH_CMD_TEMP_STATS_RSP;
+  sd.priority = k_priorityTelemetry;
+  sd.deadline = TEMPS_DEADLINE;
+  sd.okCallback = &tempStatsOk;
+  sd.okCallbackArg = &m_tempStats;
+  sd.doneCallback = &tempStatsDone;
+
+  m_tempStatsPending = Send(sd);
+  return m_tempStatsPending;
+}
+
+void Node::tempStatsDone(SendDesc &sendDesc, bool ok)
+{
+  Node &node = *sendDesc.node;
+  node.m_tempStatsPending = false;
+  node.m_tempStatsOk = ok && sendDesc.okCallbackResult;
+}
+
+bool Node::TempStats(TempStatsData &data) const
+{
+  if (!m_tempStatsOk) {
+    return false;
+  }
+
+  data = m_tempStats;
+  return true;
+}
+
+bool Node::SubscribeTemps(uint8_t intervalSec, float delta)
+{
+  m_tempSubInterval = intervalSec;
+  const float deltaRaw = delta * GH_TEMP_DELTA_SCALE;
+  m_tempSubDelta = (deltaRaw > 255) ? 255 : (uint8_t)deltaRaw;
+  m_tempPollNext = now();
+
+  // if not online yet, the subscription is sent after hello.
+  if (!m_helloOk) {
+    return true;
+  }
+  return sendTempSub();
+}
+
+bool Node::sendTempSub()
+{
+  if (m_tempSubPending) {
+    return true;
+  }
+
+  TRACE_F(
+    "Radio subscribing to temperatures, node=%02Xh, interval=%ds, delta=%d",
+    m_address,
+    m_tempSubInterval,
+    m_tempSubDelta);
+
+  SendDesc sd;
+  sd.to = m_address;
+  sd.cmd = GH_CMD_TEMP_SUB;
+  sd.data1 = m_tempSubInterval;
+  sd.data2 = m_tempSubDelta;
+  sd.priority = k_priorityHousekeeping;
+  sd.doneCallback = &tempSubDone;
+
+  m_tempSubPending = Send(sd);
+  return m_tempSubPending;
+}
+
+void Node::tempSubDone(SendDesc &sendDesc, bool ok)
+{
+  Node &node = *sendDesc.node;
+  node.m_tempSubPending = false;
+  if (!ok) {
+    TRACE_F("Error: Radio temperature subscribe failed, node=%02Xh", node.m_address);
+  }
+}
+
+void Node::OnTempPush()
+{
+  TRACE_F("Radio got temperature push from node: %02Xh", m_address);
+  if (parseTemps(&m_tempData)) {
+    m_tempDataOk = true;
+    m_tempDataTime = now();
+
+    // the node only counts what it hears toward its link fallback.
+    if (m_link == GH_LINK_ROBUST) {
+      renewKeepAlive();
+    }
+  }
+}
+
+bool Node::tempsStale() const
+{
+  if (m_tempSubInterval == 0) {
+    return false;
+  }
+
+  const unsigned long staleTime = m_tempSubInterval * 1000UL * TEMP_STALE_INTERVALS;
+  return !m_tempDataOk || ((now() - m_tempDataTime) > staleTime);
+}
+
+void Node::updateTempSub()
+{
+  if (!m_helloOk || !tempsStale() || (now() < m_tempPollNext)) {
+    return;
+  }
+
+  // pushes have stopped arriving (lost, or the node restarted), so poll
+  // once per interval and subscribe again until they're back.
+  TRACE_F("Radio temperature pushes stale, polling node: %02Xh", m_address);
+  m_tempPollNext = now() + tempPollInterval();
+  RequestTemps();
+  sendTempSub();
+}
+
+unsigned long Node::tempPollInterval() const
+{
+  // less often while polls are failing.
+  const int shift = (m_failures < POLL_BACKOFF_MAX) ? m_failures : POLL_BACKOFF_MAX;
+  return (m_tempSubInterval * 1000UL) << shift;
+}
+
+bool Node::Temps(TempData &data) const
+{
+  if (!m_tempDataOk || tempsStale()) {
+    return false;
+  }
+
+  data = m_tempData;
+  return true;
+}
+
+bool Node::RescanTemps()
+{
+  if (!keepAlive()) {
+    return false;
+  }
+
+  // the node only searches its bus again when a read fails, so a probe
+  // that's been added needs this.
+  TRACE_F("Radio asking node %02Xh to rescan temperature devices", m_address);
+  SendDesc sd;
+  sd.to = m_address;
+  sd.cmd = GH_CMD_TEMP_RESCAN;
+  sd.priority = k_priorityHousekeeping;
+  return Send(sd);
+}
+
+bool Node::TempResolution(uint8_t bits)
+{
+  if ((bits < GH_TEMP_RES_MIN) || (bits > GH_TEMP_RES_MAX)) {
+    TRACE_F("Error: Invalid temperature resolution: %d", bits);
+    return false;
+  }
+  m_tempResolution = bits;
+
+  // if not online yet, the resolution is sent with the hello.
+  if (!keepAlive()) {
+    return true;
+  }
+  return sendTempResolution();
+}
+
+// fewer bits make each conversion shorter (94ms at 9 bits, 750ms at 12),
+// so the node spends less time with the probes drawing on the bus.
+bool Node::sendTempResolution()
+{
+  TRACE_F("Radio sending temperature resolution: node=%02Xh, bits=%d", m_address, m_tempResolution);
+  SendDesc sd;
+  sd.to = m_address;
+  sd.cmd = GH_CMD_TEMP_RES;
+  sd.data1 = m_tempResolution;
+  sd.priority = k_priorityHousekeeping;
+  return Send(sd);
+}
+
+bool Node::MotorRun(MotorDirection direction, uint8_t seconds, SendPriority priority)
+{
+  if (!keepAlive()) {
+    return false;
+  }
+
+  TRACE_F("Radio sending motor run: direction=%d seconds=%d", direction, seconds);
+  SendDesc sd;
+  sd.to = m_address;
+  sd.cmd = GH_CMD_MOTOR_RUN;
+  sd.data1 = (uint8_t)direction;
+  sd.data2 = seconds;
+  sd.priority = priority;
+  sd.doneCallback = &motorRunDone;
+
+  // speed first, in the same exchange, in case the node has restarted
+  // and gone back to its default.
+  if (m_motorSpeedSet) {
+    batchAdd(sd, GH_CMD_MOTOR_SPEED, m_motorSpeed);
+    batchAdd(sd, GH_CMD_MOTOR_RUN, (uint8_t)direction, seconds);
+  }
+  return Send(sd);
+}
+
+void Node::motorRunDone(SendDesc &sendDesc, bool ok)
+{
+  (void)sendDesc; // only traced
+  if (!ok) {
+    TRACE_F("Error: Radio motor run failed, node=%02Xh", sendDesc.node->Address());
+  }
+}
+
+bool Node::MotorSpeed(uint8_t speed)
+{
+  m_motorSpeed = speed;
+  m_motorSpeedSet = true;
+
+  // if not online yet, the speed is sent with the hello.
+  if (!keepAlive()) {
+    return true;
+  }
+  return sendMotorSpeed();
+}
+
+bool Node::sendMotorSpeed()
+{
+  TRACE_F("Radio sending motor speed: node=%02Xh, speed=%d", m_address, m_motorSpeed);
+  SendDesc sd;
+  sd.to = m_address;
+  sd.cmd = GH_CMD_MOTOR_SPEED;
+  sd.data1 = m_motorSpeed;
+  return Send(sd);
+}
+
+void Node::updateLink()
+{
+  if (m_linkPending || m_helloPending || (m_link >= m_linkMax) || (now() < m_linkNext)) {
+    return;
+  }
+
+  TRACE_F("Radio moving node %02Xh up to link %d", m_address, m_link + 1);
+  sendLink(m_link + 1);
+}
+
+bool Node::sendLink(uint8_t link)
+{
+  SendDesc sd;
+  sd.to = m_address;
+  sd.cmd = GH_CMD_LINK;
+  sd.data1 = link;
+  sd.priority = k_priorityHousekeeping;
+  sd.doneCallback = &linkDone;
+
+  m_linkPending = Send(sd);
+  return m_linkPending;
+}
+
+void Node::linkDone(SendDesc &sendDesc, bool ok)
+{
+  Node &node = *sendDesc.node;
+  node.m_linkPending = false;
+  if (!ok) {
+    // the node may have switched and only the ack was lost; if so the
+    // next exchanges fail too, and fall back. not if it said no.
+    if (!sendDesc.rejected && (node.m_failures >= LINK_FAILURES_MAX)) {
+      node.linkFallback();
+    }
+    return;
+  }
+
+  // a window on the new link before the next step up, or a long wait
+  // after stepping down.
+  const bool up = sendDesc.data1 > node.m_link;
+  node.m_linkNext = node.now() + (up ? LINK_STEP_TIME : LINK_BACKOFF);
+  node.m_link = sendDesc.data1;
+  node.m_linkExchanges = 0;
+  node.m_linkRetries = 0;
+  node.renewKeepAlive();
+  TRACE_F("Radio node %02Xh on link %d", node.m_address, node.m_link);
+}
+
+void Node::linkSample(const SendDesc &sendDesc, bool ok)
+{
+  if ((m_link == GH_LINK_ROBUST) || (sendDesc.cmd == GH_CMD_LINK)) {
+    return;
+  }
+
+  // a rejected request still got through. one failure is counted with
+  // the rest; only a node that's stopped answering is taken to have gone
+  // back to robust.
+  const bool failed = !ok && !sendDesc.rejected;
+  if (failed && (m_failures >= LINK_FAILURES_MAX)) {
+    TRACE_F("Error: Radio exchanges failed on link %d, node=%02Xh", m_link, m_address);
+    linkFallback();
+    return;
+  }
+
+  m_linkExchanges++;
+  m_linkRetries += sendDesc.attempts - 1;
+  if (m_linkExchanges < LINK_WINDOW) {
+    return;
+  }
+
+  // the retries cost more air than the faster link saves.
+  if (((m_linkRetries * LINK_RETRY_RATIO) > m_linkExchanges) && !m_linkPending) {
+    TRACE_F(
+      "Radio moving node %02Xh down from link %d, retries=%d/%d",
+      m_address,
+      m_link,
+      m_linkRetries,
+      m_linkExchanges);
+    sendLink(m_link - 1);
+  }
+  m_linkExchanges = 0;
+  m_linkRetries = 0;
+}
+
+void Node::linkFallback()
+{
+  // the node goes back to robust by itself once it stops hearing from
+  // us, so wait for that and then say hello again.
+  TRACE_F("Radio node %02Xh falling back to robust link", m_address);
+  m_link = GH_LINK_ROBUST;
+  m_linkNext = now() + LINK_BACKOFF;
+  m_helloOk = false;
+  m_nextReconnect = now() + GH_LINK_FALLBACK + RECONNECT_TIME;
+}
+
+} // namespace radio
+
+// end Node class
+
+// begin free functions
+
+void printBuffer(const char *prompt, const uint8_t *data, uint8_t dataLen)
+{
+#if RADIO_TRACE
+  char printBuf[32 + (GH_LENGTH_MAX * 3)];
+  strcpy(printBuf, prompt);
+  int printLen = strlen(printBuf);
+  for (uint8_t i = 0; i < dataLen; i++) {
+    sprintf(printBuf + printLen, "%02Xh", (unsigned int)data[i]);
+    printLen += 2;
+
+    if (i != dataLen - 1) {
+      printBuf[printLen++] = ' ';
+    }
+  }
+  printBuf[printLen] = '\0';
+  TRACE_C(printBuf);
+#else
+  (void)prompt;
+  (void)data;
+  (void)dataLen;
+#endif
+}
+
+// bit for a group member in SendDesc::groupMask; none if the address
+// can't be in a group.
+uint32_t groupBit(uint8_t address)
+{
+  const int index = GH_NODE_INDEX(address);
+  if ((index < 0) || (index >= RADIO_GROUP_NODES_MAX)) {
+    return 0;
+  }
+  return 1UL << index;
+}
+
+// end free functions
+
+} // namespace greenhouse
+} // namespace native
+
@@ -0,0 +1,338 @@
+#pragma once
+
+#include "../../../common/common.h"
+#include "../../../common/log.h"
+#include "../IRadioTransport.h"
+#include "RadioStats.h"
+
+#include <gh_protocol.h>
+
+#include <deque>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TEMP_DEVS_MAX GH_TEMP_DEVS_MAX
+#define RADIO_IN_FLIGHT_MAX 8  // requests waiting for responses (one per node or group)
+#define RADIO_IN_FLIGHT_RESERVED 2 // of those, kept for actuation
+#define RADIO_GROUP_NODES_MAX 32 // group members need a GH_NODE_INDEX below this
+#define RADIO_UPDATE_NODES 4     // nodes serviced per Update
+#define RADIO_UPDATE_QUEUE_MAX 2 // queued requests before background work waits
+#define UNKNOWN_ADDRESS 255
+
+namespace native {
+namespace greenhouse {
+
+class Radio;
+
+namespace radio {
+
+struct SendDesc;
+class Node;
+
+typedef bool (*callback)(SendDesc &sendDesc);
+typedef void (*sendDone)(SendDesc &sendDesc, bool ok);
+
+// highest first; queued requests start in this order, oldest first within
+// a priority.
+enum SendPriority {
+  k_prioritySafety,       // actuation that protects the greenhouse (close on rain)
+  k_priorityUser,         // other actuation and settings
+  k_priorityTelemetry,    // sensor polls
+  k_priorityHousekeeping, // keep alive, subscribes, link changes
+  k_priorityCount
+};
+
+struct SendDesc {
+  uint8_t to = 0;
+  uint8_t cmd = 0;
+  uint8_t data1 = 0;
+  uint8_t data2 = 0;
+  uint8_t seq = 0;
+  int errors = 0;
+  int attempts = 0; // transmissions so far
+  int retryMax = 0; // 0 for the radio's RetryMax
+  uint8_t expectCmd = GH_CMD_ACK;
+  SendPriority priority = k_priorityUser;
+
+  // dropped if it hasn't started this long (ms) after being queued, as
+  // failed; 0 to wait as long as it takes.
+  unsigned long deadline = 0;
+  unsigned long queued = 0;
+  callback okCallback = NULL;
+  bool okCallbackResult = false;
+
+  // the node answered, but with an error or a response that didn't check
+  // out; failed, though the link is fine.
+  bool rejected = false;
+  void *okCallbackArg = NULL;
+
+  // group sends only; bit per node index (GH_NODE_INDEX) yet to ack.
+  uint32_t groupMask = 0;
+
+  // batch sends only (see batchAdd); entries are [cmd, data1, data2].
+  uint8_t batch[GH_BATCH_MAX][GH_BATCH_ENTRY_LENGTH] = {};
+  uint8_t batchCount = 0;
+
+  // called from Radio::Loop once the send has finished (ok or failed).
+  Node *node = nullptr;
+  sendDone doneCallback = NULL;
+};
+
+bool batchAdd(SendDesc &sendDesc, uint8_t cmd, uint8_t data1 = 0, uint8_t data2 = 0);
+bool batchHas(const SendDesc &sendDesc, uint8_t cmd, uint8_t data1 = 0, uint8_t data2 = 0);
+
+enum NodeCaps { k_capTemps = 1 << 0, k_capMotor = 1 << 1 };
+
+enum MotorDirection { k_windowExtend = GH_MOTOR_FORWARD, k_windowRetract = GH_MOTOR_REVERSE };
+
+
+// a request waiting for its response; at most one per node (or group),
+// matched to responses by node address and sequence.
+struct InFlight {
+  bool active = false;
+  SendDesc sendDesc;
+  int attempt = 0;
+  unsigned long start = 0;
+  unsigned long timeout = 0;
+};
+
+struct TempData {
+  int devs;
+  float temps[TEMP_DEVS_MAX];
+};
+
+// over the node's recent reads; age is secs since its last read, when
+// the stats were sent.
+struct TempStat {
+  float min;
+  float max;
+  float mean;
+  int age;
+};
+
+struct TempStatsData {
+  int devs;
+  TempStat stats[TEMP_DEVS_MAX];
+};
+
+class Node {
+public:
+  Node();
+  void Init(native::greenhouse::Radio &radio, uint8_t address, uint8_t caps);
+  void Update();
+  bool Online();
+  bool Send(radio::SendDesc &sendDesc);
+  bool RequestTemps();
+  bool SubscribeTemps(uint8_t intervalSec, float delta);
+  bool Temps(TempData &data) const;
+  bool RescanTemps();
+  bool RequestTempStats();
+  bool TempStats(TempStatsData &data) const;
+  bool TempResolution(uint8_t bits);
+  void OnTempPush();
+  bool MotorRun(MotorDirection direction, uint8_t seconds, SendPriority priority = k_priorityUser);
+  bool MotorSpeed(uint8_t speed);
+  void OnSendDone(SendDesc &sendDesc, bool ok);
+  void OnRttSample(unsigned long rtt);
+  uint8_t Address() const { return m_address; }
+  bool Has(NodeCaps cap) const { return (m_caps & cap) != 0; }
+
+  // hamming coded frames, for a noisy link; twice the time on air, but
+  // single bit errors don't cost a retry. the node replies in kind.
+  void Fec(bool value) { m_fec = value; }
+  bool Fec() const { return m_fec; }
+
+  // the fastest link to try; the node is moved up a step at a time while
+  // exchanges go cleanly, and back down when they don't.
+  void LinkMax(uint8_t value) { m_linkMax = value; }
+  uint8_t LinkMax() const { return m_linkMax; }
+  uint8_t Link() const { return m_link; }
+  int Errors() const { return m_errors; }
+  unsigned long Rto() const { return m_rto; }
+  NodeStats &Stats() { return m_stats; }
+  const NodeStats &Stats() const { return m_stats; }
+
+protected:
+  native::greenhouse::Radio &Radio() const
+  {
+    if (m_radio == nullptr) {
+      TRACE("Fatal: Radio not set for node");
+      common::halt();
+    }
+    return *m_radio;
+  }
+
+private:
+  unsigned long now() const;
+  bool hello();
+  bool keepAlive();
+  bool keepAliveExpired();
+  void renewKeepAlive();
+  void scheduleReconnect();
+  unsigned long tempPollInterval() const;
+  void stepSequence();
+  void updateTempSub();
+  bool tempsStale() const;
+  bool sendTempSub();
+  bool sendMotorSpeed();
+  bool sendTempResolution();
+  void updateLink();
+  bool sendLink(uint8_t link);
+  void linkSample(const SendDesc &sendDesc, bool ok);
+  void linkFallback();
+  static void linkDone(SendDesc &sendDesc, bool ok);
+  static void helloDone(SendDesc &sendDesc, bool ok);
+  static void tempsDone(SendDesc &sendDesc, bool ok);
+  static void tempSubDone(SendDesc &sendDesc, bool ok);
+  static void tempStatsDone(SendDesc &sendDesc, bool ok);
+  static void motorRunDone(SendDesc &sendDesc, bool ok);
+
+private:
+  bool m_init;
+  native::greenhouse::Radio *m_radio;
+  TempData m_tempData;
+  bool m_tempDataOk;
+  bool m_tempsPending;
+  unsigned long m_tempDataTime;
+  uint8_t m_tempSubInterval;
+  uint8_t m_tempSubDelta;
+  bool m_tempSubPending;
+  uint8_t m_tempResolution;
+  TempStatsData m_tempStats;
+  bool m_tempStatsOk;
+  bool m_tempStatsPending;
+  uint8_t m_motorSpeed;
+  bool m_motorSpeedSet;
+  unsigned long m_tempPollNext;
+  uint8_t m_address;
+  uint8_t m_caps;
+  bool m_fec;
+  uint8_t m_link;
+  uint8_t m_linkMax;
+  bool m_linkPending;
+  unsigned long m_linkNext;
+  int m_linkExchanges;
+  int m_linkRetries;
+  bool m_helloOk;
+  bool m_helloPending;
+  unsigned long m_keepAliveExpiry;
+  unsigned long m_nextReconnect;
+  unsigned long m_reconnectDelay;
+  int m_failures; // exchanges failed in a row
+  uint32_t m_random;
+  uint8_t m_sequence;
+  int m_errors;
+  unsigned long m_srtt;
+  unsigned long m_rttVar;
+  unsigned long m_rto;
+  NodeStats m_stats;
+};
+
+} // namespace radio
+
+// sends are asynchronous; Send queues the request, and Loop (which must
+// be called often) transmits, waits for the response and retries without
+// blocking. the outcome is reported through the node's done callback.
+// requests to different nodes are in flight at the same time.
+// nodes are added at runtime; Update spreads their background work
+// (keep alive, polls) over calls so that a call's cost stays the same
+// as nodes are added. each node has its own link rate; the module is
+// switched between them as requests start. time on air is estimated for
+// each frame sent, and telemetry and housekeeping wait while it's over
+// the duty cycle, so keep alives and polls can't crowd out the band.
+// switching the module takes a few hundred ms, and runs from Loop too.
+// actuation starts ahead of them, and has in-flight slots of its own, so
+// it isn't held up by however many polls are going on.
+class Radio {
+public:
+  Radio();
+  void Init(IRadioTransport &transport);
+  void Loop();
+  void Update();
+  bool Send(radio::SendDesc &sendDesc);
+  radio::Node *AddNode(uint8_t address, uint8_t caps);
+  radio::Node *FindNode(uint8_t address);
+  radio::Node &Node(int index);
+  int NodeCount() const { return (int)m_nodes.size(); }
+  void MotorRunAll(
+    radio::MotorDirection direction,
+    uint8_t seconds,
+    radio::SendPriority priority = radio::k_priorityUser);
+  unsigned long Millis() { return Transport().Millis(); }
+  int Requests() const { return m_requests; }
+  int Errors() const { return m_errors; }
+  int Queued() const;
+
+  // the module is being switched, or the boot sweep isn't done yet.
+  bool LinkBusy() const { return m_linkSwitching || (m_linkSweep <= GH_LINK_MAX); }
+
+  // share of the last AIRTIME_WINDOW spent transmitting, 0 to 1.
+  float Utilisation() { return m_airtime.Utilisation(Millis()); }
+
+public:
+  // getters & setters
+  IRadioTransport &Transport()
+  {
+    if (m_transport == nullptr) {
+      TRACE("Fatal: Radio transport not set");
+      common::halt();
+    }
+    return *m_transport;
+  }
+  void RetryMax(int value) { m_retryMax = value; }
+  int RetryMax() const { return m_retryMax; }
+  void RtoInitial(unsigned long value) { m_rtoInitial = value; }
+  unsigned long RtoInitial() const { return m_rtoInitial; }
+  void RtoMin(unsigned long value) { m_rtoMin = value; }
+  unsigned long RtoMin() const { return m_rtoMin; }
+  void RtoMax(unsigned long value) { m_rtoMax = value; }
+  unsigned long RtoMax() const { return m_rtoMax; }
+  void KeepAliveIdle(unsigned long value) { m_keepAliveIdle = value; }
+  unsigned long KeepAliveIdle() const { return m_keepAliveIdle; }
+  void DutyCycleMax(float value) { m_dutyCycleMax = value; }
+  float DutyCycleMax() const { return m_dutyCycleMax; }
+
+private:
+  void startQueued();
+  void dropExpired();
+  void transmit(radio::InFlight &inFlight);
+  bool fec(const radio::SendDesc &sendDesc);
+  uint8_t link(const radio::SendDesc &sendDesc);
+  bool inFlight() const;
+  bool overDutyCycle();
+  bool linkReady();
+  void switchLink(uint8_t from, uint8_t to);
+  void receive();
+  bool handleResponse(radio::InFlight &inFlight);
+  void handleGroupAck(radio::InFlight &inFlight);
+  unsigned long rto(const radio::SendDesc &sendDesc);
+  void count(const radio::SendDesc &sendDesc, radio::StatsCounter counter);
+  radio::InFlight *findInFlight(uint8_t address);
+  radio::InFlight *findGroupInFlight(uint8_t seq);
+  radio::InFlight *freeInFlight(radio::SendPriority priority);
+  void retry(radio::InFlight &inFlight);
+  void complete(radio::InFlight &inFlight, bool rx);
+
+private:
+  IRadioTransport *m_transport;
+  std::deque<radio::Node> m_nodes; // deque, so nodes don't move as more are added
+  int m_updateNext;
+  int m_requests;
+  int m_errors;
+  int m_retryMax;
+  unsigned long m_rtoInitial;
+  unsigned long m_rtoMin;
+  unsigned long m_rtoMax;
+  unsigned long m_keepAliveIdle;
+  uint8_t m_groupSequence;
+  uint8_t m_link;
+  bool m_linkSwitching;
+  uint8_t m_linkSweep; // next setting the module may be on at boot
+  float m_dutyCycleMax;
+  radio::AirtimeWindow m_airtime;
+  std::deque<radio::SendDesc> m_sendQueue[radio::k_priorityCount];
+  radio::InFlight m_inFlight[RADIO_IN_FLIGHT_MAX];
+};
+
+} // namespace greenhouse
+} // namespace native
@@ -0,0 +1,133 @@
+#include "RadioStats.h"
+
+#include <gh_protocol.h>
+
+namespace native {
+namespace greenhouse {
+namespace radio {
+
+// upper bound of each bucket (ms); the last one takes the rest.
+static const unsigned long s_rttBuckets[RTT_BUCKETS - 1] = {
+  25, 50, 100, 150, 250, 400, 600, 1000, 2000};
+
+StatsCmd statsCmd(uint8_t cmd)
+{
+  switch (cmd) {
+  case GH_CMD_HELLO:
+    return k_statsHello;
+  case GH_CMD_TEMP_ALL_REQ:
+    return k_statsTemps;
+  case GH_CMD_TEMP_SUB:
+    return k_statsTempSub;
+  case GH_CMD_MOTOR_SPEED:
+    return k_statsMotorSpeed;
+  case GH_CMD_MOTOR_RUN:
+    return k_statsMotorRun;
+  case GH_CMD_BATCH:
+    return k_statsBatch;
+  case GH_CMD_LINK:
+    return k_statsLink;
+  case GH_CMD_TEMP_STATS_REQ:
+    return k_statsTempStats;
+  default:
+    return k_statsOther;
+  }
+}
+
+const char *statsCmdName(StatsCmd cmd)
+{
+  switch (cmd) {
+  case k_statsHello:
+    return "hello";
+  case k_statsTemps:
+    return "temps";
+  case k_statsTempSub:
+    return "temp-sub";
+  case k_statsMotorSpeed:
+    return "motor-speed";
+  case k_statsMotorRun:
+    return "motor-run";
+  case k_statsBatch:
+    return "batch";
+  case k_statsLink:
+    return "link";
+  case k_statsTempStats:
+    return "temp-stats";
+  default:
+    return "other";
+  }
+}
+
+RttHistogram::RttHistogram() : m_counts(), m_count(0), m_max(0) {}
+
+void RttHistogram::Add(unsigned long rtt)
+{
+  int i = 0;
+  while ((i < RTT_BUCKETS - 1) && (rtt > s_rttBuckets[i])) {
+    i++;
+  }
+
+  m_counts[i]++;
+  m_count++;
+  if (rtt > m_max) {
+    m_max = rtt;
+  }
+}
+
+unsigned long RttHistogram::Percentile(int p) const
+{
+  if (m_count == 0) {
+    return 0;
+  }
+
+  // rank of the sample we want, rounded up (1 based).
+  const unsigned long rank = ((m_count * p) + 99) / 100;
+  unsigned long seen = 0;
+  for (int i = 0; i < RTT_BUCKETS - 1; i++) {
+    seen += m_counts[i];
+    if (seen >= rank) {
+      return (s_rttBuckets[i] < m_max) ? s_rttBuckets[i] : m_max;
+    }
+  }
+  return m_max;
+}
+
+AirtimeWindow::AirtimeWindow() : m_buckets(), m_bucketStart(0), m_current(0) {}
+
+void AirtimeWindow::Add(unsigned long now, unsigned long us)
+{
+  advance(now);
+  m_buckets[m_current] += us;
+}
+
+float AirtimeWindow::Utilisation(unsigned long now)
+{
+  advance(now);
+  unsigned long us = 0;
+  for (int i = 0; i < AIRTIME_BUCKETS; i++) {
+    us += m_buckets[i];
+  }
+  return us / (AIRTIME_WINDOW * 1000.0f);
+}
+
+void AirtimeWindow::advance(unsigned long now)
+{
+  const unsigned long bucketTime = AIRTIME_WINDOW / AIRTIME_BUCKETS;
+  if ((now - m_bucketStart) >= AIRTIME_WINDOW) {
+    for (int i = 0; i < AIRTIME_BUCKETS; i++) {
+      m_buckets[i] = 0;
+    }
+    m_bucketStart = now;
+    return;
+  }
+
+  while ((now - m_bucketStart) >= bucketTime) {
+    m_current = (m_current + 1) % AIRTIME_BUCKETS;
+    m_buckets[m_current] = 0;
+    m_bucketStart += bucketTime;
+  }
+}
+
+} // namespace radio
+} // namespace greenhouse
+} // namespace native
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+
+#define RTT_BUCKETS 10
+#define AIRTIME_BUCKETS 10
+#define AIRTIME_WINDOW 60000 // ms
+
+namespace native {
+namespace greenhouse {
+namespace radio {
+
+// commands are grouped for stats, since only a few are ever sent.
+enum StatsCmd {
+  k_statsHello,
+  k_statsTemps,
+  k_statsTempSub,
+  k_statsMotorSpeed,
+  k_statsMotorRun,
+  k_statsBatch,
+  k_statsLink,
+  k_statsTempStats,
+  k_statsOther,
+  k_statsCmdCount
+};
+
+enum StatsCounter {
+  k_statsAttempts,
+  k_statsOk,
+  k_statsFailed,
+  k_statsTimeouts,
+  k_statsCorrupt,    // crc mismatch or underrun
+  k_statsUnexpected, // error or wrong response command
+  k_statsExpired,    // dropped from the queue at its deadline
+  k_statsCounterCount
+};
+
+StatsCmd statsCmd(uint8_t cmd);
+const char *statsCmdName(StatsCmd cmd);
+
+// fixed buckets, so percentiles are the upper bound of their bucket
+// (the max is exact).
+class RttHistogram {
+public:
+  RttHistogram();
+  void Add(unsigned long rtt);
+  unsigned long Percentile(int p) const;
+  unsigned long Count() const { return m_count; }
+  unsigned long Max() const { return m_max; }
+
+private:
+  unsigned long m_counts[RTT_BUCKETS];
+  unsigned long m_count;
+  unsigned long m_max;
+};
+
+// time on air over the last AIRTIME_WINDOW, kept in buckets so that old
+// airtime drops out a bucket at a time.
+class AirtimeWindow {
+public:
+  AirtimeWindow();
+  void Add(unsigned long now, unsigned long us);
+
+  // share of the window on air, 0 to 1.
+  float Utilisation(unsigned long now);
+
+private:
+  void advance(unsigned long now);
+
+private:
+  unsigned long m_buckets[AIRTIME_BUCKETS]; // us
+  unsigned long m_bucketStart;
+  int m_current;
+};
+
+struct NodeStats {
+  unsigned long counts[k_statsCmdCount][k_statsCounterCount] = {};
+  RttHistogram rtt;
+  unsigned long fecCorrected = 0; // bits
+};
+
+} // namespace radio
+} // namespace greenhouse
+} // namespace native
@@ -0,0 +1,540 @@
+#include "SimRadioChannel.h"
+
+#include <gh_protocol.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_LINK_SWITCH 360 // at command mode in and out, as the node does
+#define SIM_NODE_TX_DELAY 20 // node waits before replying (TX_WAIT_DELAY)
+#define SIM_NODE_TX_MARGIN 30 // node waits for the ack to go before a switch (HC12_TX_MARGIN)
+#define SIM_TEMP_DEVS 2
+#define SIM_TEMP_RAW 328 // 20.5C
+
+SimRadioChannel::SimRadioChannel(const SimRadioConfig &config) :
+  m_config(config),
+  m_random(config.seed),
+  m_now(0),
+  m_link(GH_LINK_ROBUST),
+  m_moduleLink(GH_LINK_ROBUST),
+  m_linkDoneAt(0),
+  m_framesSent(0),
+  m_framesLost(0)
+{
+}
+
+void SimRadioChannel::AddNode(uint8_t address, float fastLoss)
+{
+  SimNode node;
+  node.address = address;
+  gh_dedupeInit(&node.dedupe);
+  node.motorRuns = 0;
+  node.motorSpeed = 0;
+  node.tempResolution = GH_TEMP_RES_MAX;
+  for (int i = 0; i < SIM_TEMP_DEVS; i++) {
+    node.temps[i] = SIM_TEMP_RAW + (i * 8); // 20.5C and 21C
+    node.tempsPushed[i] = node.temps[i];
+  }
+  node.pushInterval = 0;
+  node.pushDelta = 0;
+  node.nextPush = 0;
+  node.pushes = 0;
+  node.link = GH_LINK_ROBUST;
+  node.linkNext = GH_LINK_ROBUST;
+  node.linkAt = 0;
+  node.lastRx = 0;
+  node.replyAt = 0;
+  node.latency = 0;
+  node.deafUntil = 0;
+  node.fastLoss = fastLoss;
+  node.loseReplyTo = 0;
+  gh_parseInit(&node.parser, node.rxBuf);
+  m_nodes.push_back(node);
+}
+
+int SimRadioChannel::MotorRuns(uint8_t address) const
+{
+  for (const SimNode &node : m_nodes) {
+    if (node.address == address) {
+      return node.motorRuns;
+    }
+  }
+  return 0;
+}
+
+int SimRadioChannel::MotorSpeed(uint8_t address) const
+{
+  for (const SimNode &node : m_nodes) {
+    if (node.address == address) {
+      return node.motorSpeed;
+    }
+  }
+  return 0;
+}
+
+int SimRadioChannel::TempResolution(uint8_t address) const
+{
+  for (const SimNode &node : m_nodes) {
+    if (node.address == address) {
+      return node.tempResolution;
+    }
+  }
+  return 0;
+}
+
+void SimRadioChannel::Temp(uint8_t address, int dev, float temp)
+{
+  for (SimNode &node : m_nodes) {
+    if (node.address == address) {
+      node.temps[dev] = (int16_t)(temp * 16);
+    }
+  }
+}
+
+int SimRadioChannel::TempPushInterval(uint8_t address) const
+{
+  for (const SimNode &node : m_nodes) {
+    if (node.address == address) {
+      return node.pushInterval;
+    }
+  }
+  return 0;
+}
+
+int SimRadioChannel::TempPushDelta(uint8_t address) const
+{
+  for (const SimNode &node : m_nodes) {
+    if (node.address == address) {
+      return node.pushDelta;
+    }
+  }
+  return 0;
+}
+
+int SimRadioChannel::TempPushes(uint8_t address) const
+{
+  for (const SimNode &node : m_nodes) {
+    if (node.address == address) {
+      return node.pushes;
+    }
+  }
+  return 0;
+}
+
+void SimRadioChannel::LoseReply(uint8_t address, uint8_t cmd)
+{
+  for (SimNode &node : m_nodes) {
+    if (node.address == address) {
+      node.loseReplyTo = cmd;
+    }
+  }
+}
+
+void SimRadioChannel::NodeLatency(uint8_t address, unsigned long latency)
+{
+  for (SimNode &node : m_nodes) {
+    if (node.address == address) {
+      node.latency = latency;
+    }
+  }
+}
+
+void SimRadioChannel::NodeDeaf(uint8_t address, unsigned long ms)
+{
+  for (SimNode &node : m_nodes) {
+    if (node.address == address) {
+      node.deafUntil = m_now + ms;
+    }
+  }
+}
+
+int SimRadioChannel::NodeLink(uint8_t address) const
+{
+  for (const SimNode &node : m_nodes) {
+    if (node.address == address) {
+      return node.link;
+    }
+  }
+  return GH_LINK_ROBUST;
+}
+
+void SimRadioChannel::Step(unsigned long ms)
+{
+  for (unsigned long i = 0; i < ms; i++) {
+    m_now++;
+
+    for (SimNode &node : m_nodes) {
+      nodeLink(node);
+      nodePush(node);
+    }
+
+    // deliver in order of arrival; a node may queue a reply on delivery.
+    while (true) {
+      auto next = m_frames.end();
+      for (auto it = m_frames.begin(); it != m_frames.end(); ++it) {
+        if ((it->arrival <= m_now) && ((next == m_frames.end()) || (it->arrival < next->arrival))) {
+          next = it;
+        }
+      }
+      if (next == m_frames.end()) {
+        break;
+      }
+
+      const SimFrame frame = *next;
+      m_frames.erase(next);
+      deliver(frame);
+    }
+  }
+}
+
+int SimRadioChannel::Read(uint8_t *buf, int length)
+{
+  // frames arrive whole, so there's never anything to wait for.
+  int read = 0;
+  while ((read < length) && !m_rxBytes.empty()) {
+    buf[read++] = m_rxBytes.front();
+    m_rxBytes.pop_front();
+  }
+  return read;
+}
+
+void SimRadioChannel::Write(const uint8_t *buf, int length)
+{
+  // at another baud, the module only gets garbage.
+  if ((m_link != m_moduleLink) || !LinkDone()) {
+    m_framesSent++;
+    m_framesLost++;
+    return;
+  }
+  transmit(false, m_moduleLink, buf, length, 0);
+}
+
+void SimRadioChannel::Link(uint8_t from, uint8_t to)
+{
+  // the module only takes the at commands at the baud it's on; the uart
+  // moves either way. deaf while switching, as is the module.
+  if (from == m_moduleLink) {
+    m_moduleLink = to;
+  }
+  m_link = to;
+  m_linkDoneAt = m_now + SIM_LINK_SWITCH;
+}
+
+bool SimRadioChannel::chance(float p)
+{
+  return std::uniform_real_distribution<float>(0, 1)(m_random) < p;
+}
+
+bool SimRadioChannel::lost(const SimNode &node, uint8_t link)
+{
+  return (link != GH_LINK_ROBUST) && chance(node.fastLoss);
+}
+
+void SimRadioChannel::transmit(bool toMain, uint8_t link, const uint8_t *buf, int length, unsigned long delay)
+{
+  m_framesSent++;
+  if (chance(m_config.loss)) {
+    m_framesLost++;
+    return;
+  }
+
+  SimFrame frame;
+  frame.toMain = toMain;
+  frame.link = link;
+  frame.data.assign(buf, buf + length);
+  if (chance(m_config.corrupt)) {
+    frame.data[m_random() % length] ^= 1 << (m_random() % 8);
+  }
+  if (m_config.bitError != 0) {
+    for (uint8_t &b : frame.data) {
+      for (int i = 0; i < 8; i++) {
+        if (chance(m_config.bitError)) {
+          b ^= 1 << i;
+        }
+      }
+    }
+  }
+  if (chance(m_config.noise)) {
+    frame.data.insert(frame.data.begin(), (uint8_t)m_random());
+  }
+  length = (int)frame.data.size();
+
+  const unsigned long air = (length * 10000UL) / GH_LINK_BAUD(link);
+  const int copies = chance(m_config.duplicate) ? 2 : 1;
+  for (int i = 0; i < copies; i++) {
+    const unsigned long jitter = (m_config.jitter != 0) ? (m_random() % (m_config.jitter + 1)) : 0;
+    frame.arrival = m_now + delay + air + m_config.latency + jitter + (i * air);
+    m_frames.push_back(frame);
+  }
+}
+
+void SimRadioChannel::deliver(const SimFrame &frame)
+{
+  if (frame.toMain) {
+    if ((frame.link != m_moduleLink) || (m_link != m_moduleLink) || !LinkDone()) {
+      return;
+    }
+    m_rxBytes.insert(m_rxBytes.end(), frame.data.begin(), frame.data.end());
+    return;
+  }
+
+  // as the node does, a byte at a time; corrupt frames are dropped.
+  for (SimNode &node : m_nodes) {
+    if ((frame.link != node.link) || lost(node, frame.link)) {
+      continue;
+    }
+
+    node.parser.buf = node.rxBuf;
+    for (uint8_t b : frame.data) {
+      if (gh_parse(&node.parser, b) == GH_PARSE_FRAME) {
+        nodeReceive(node, node.rxBuf, node.parser.fec);
+      }
+    }
+  }
+}
+
+void SimRadioChannel::nodeReceive(SimNode &node, const uint8_t *rx, bool fec)
+{
+  const bool group = (GH_TO(rx) == GH_ADDR_WINDOWS);
+  if ((GH_TO(rx) != node.address) && !group) {
+    return;
+  }
+  if (m_now < node.deafUntil) {
+    return;
+  }
+
+  node.lastRx = m_now;
+
+  // as the node does, deaf while a group reply waits for its slot.
+  if (m_now < node.replyAt) {
+    return;
+  }
+
+  unsigned long delay = SIM_NODE_TX_DELAY + node.latency;
+  if (group) {
+    node.replyAt = m_now + (GH_GROUP_ACK_SLOT * GH_NODE_INDEX(node.address));
+    delay += GH_GROUP_ACK_SLOT * GH_NODE_INDEX(node.address);
+  }
+
+  // as the node does (with the same window), send the last reply to this
+  // sender again for a retry, rather than running it twice, and drop
+  // anything older.
+  const uint8_t key = group ? GH_TO(rx) : GH_FROM(rx);
+  gh_dedupeWindow *window = gh_dedupeFind(&node.dedupe, key, GH_SEQ(rx));
+  std::vector<uint8_t> &reply = group ? node.groupReply : node.reply;
+  const bool hello = (GH_CMD(rx) == GH_CMD_HELLO) ||
+                     ((GH_CMD(rx) == GH_CMD_BATCH) && (GH_DATA_1(rx) != 0) &&
+                      (GH_BATCH_ENTRY(rx, 0, 0) == GH_CMD_HELLO));
+  if (gh_dedupeSeen(window, GH_SEQ(rx), hello)) {
+    if (gh_dedupeIsLast(window, GH_CMD(rx), GH_SEQ(rx))) {
+      nodeTransmit(node, reply.data(), fec, delay);
+    }
+    return;
+  }
+
+  uint8_t tx[GH_LENGTH_MAX];
+  GH_LEN(tx) = GH_PAYLOAD_DEFAULT;
+  GH_TO(tx) = GH_FROM(rx);
+  GH_FROM(tx) = node.address;
+  GH_SEQ(tx) = GH_SEQ(rx);
+  switch (GH_CMD(rx)) {
+
+    case GH_CMD_TEMP_ALL_REQ: {
+      GH_CMD(tx) = GH_CMD_TEMP_ALL_RSP;
+      nodeTemps(node, tx);
+    } break;
+
+    case GH_CMD_TEMP_STATS_REQ: {
+      // 20.5C to 21C, 20.75C mean, read 5s ago; the last device has no reads.
+      GH_CMD(tx) = GH_CMD_TEMP_STATS_RSP;
+      GH_DATA_1(tx) = SIM_TEMP_DEVS;
+      for (int i = 0; i < SIM_TEMP_DEVS - 1; i++) {
+        GH_TEMP_STATS_DATA(tx, i, GH_TEMP_STATS_MIN) = 72;
+        GH_TEMP_STATS_DATA(tx, i, GH_TEMP_STATS_MIN + 1) = 1;
+        GH_TEMP_STATS_DATA(tx, i, GH_TEMP_STATS_MAX) = 80;
+        GH_TEMP_STATS_DATA(tx, i, GH_TEMP_STATS_MAX + 1) = 1;
+        GH_TEMP_STATS_DATA(tx, i, GH_TEMP_STATS_MEAN) = 76;
+        GH_TEMP_STATS_DATA(tx, i, GH_TEMP_STATS_MEAN + 1) = 1;
+        GH_TEMP_STATS_DATA(tx, i, GH_TEMP_STATS_AGE) = 5;
+      }
+      memset(&GH_TEMP_STATS_DATA(tx, SIM_TEMP_DEVS - 1, 0), GH_TEMP_UNKNOWN, GH_TEMP_STATS_ENTRY_LENGTH);
+      GH_LEN(tx) = GH_TEMP_STATS_LENGTH(SIM_TEMP_DEVS);
+    } break;
+
+    case GH_CMD_BATCH: {
+      const uint8_t count = GH_DATA_1(rx);
+      if ((count == 0) || (count > GH_BATCH_MAX) || (GH_LEN(rx) != GH_BATCH_LENGTH(count))) {
+        GH_CMD(tx) = GH_CMD_ERROR;
+        GH_DATA_1(tx) = GH_ERROR_BAD_CMD;
+        GH_DATA_2(tx) = GH_CMD_BATCH;
+        break;
+      }
+      GH_CMD(tx) = GH_CMD_BATCH_RSP;
+      GH_LEN(tx) = GH_BATCH_LENGTH(count);
+      GH_DATA_1(tx) = count;
+      for (int i = 0; i < count; i++) {
+        nodeCommand(node, &GH_BATCH_ENTRY(rx, i, 0), &GH_BATCH_ENTRY(tx, i, 0));
+      }
+    } break;
+
+    default: {
+      const uint8_t req[GH_BATCH_ENTRY_LENGTH] = { GH_CMD(rx), GH_DATA_1(rx), GH_DATA_2(rx) };
+      uint8_t rsp[GH_BATCH_ENTRY_LENGTH];
+      nodeCommand(node, req, rsp);
+      GH_CMD(tx) = rsp[0];
+      GH_DATA_1(tx) = rsp[1];
+      GH_DATA_2(tx) = rsp[2];
+    } break;
+  }
+
+  gh_crcWrite(tx);
+  gh_dedupeHandled(window, GH_CMD(rx), GH_SEQ(rx));
+  reply.assign(tx, tx + GH_FRAME_LENGTH(tx));
+  if (node.loseReplyTo == GH_CMD(rx)) {
+    node.loseReplyTo = 0;
+  }
+  else {
+    nodeTransmit(node, tx, fec, delay);
+  }
+
+  // as the node does, once the ack is off the air.
+  if (node.linkNext != node.link) {
+    const int bytes = GH_SOF_LENGTH + (fec ? GH_FEC_LENGTH(GH_FRAME_LENGTH(tx)) : GH_FRAME_LENGTH(tx));
+    const unsigned long air = (bytes * 10000UL) / GH_LINK_BAUD(node.link);
+    node.linkAt = m_now + delay + air + SIM_NODE_TX_MARGIN + SIM_LINK_SWITCH;
+  }
+}
+
+// as the node does, reply the way the request came.
+void SimRadioChannel::nodeTransmit(SimNode &node, const uint8_t *frame, bool fec, unsigned long delay)
+{
+  if (lost(node, node.link)) {
+    return;
+  }
+
+  std::vector<uint8_t> stream;
+  stream.push_back(fec ? GH_SOF_FEC : GH_SOF);
+  for (int i = 0; i < GH_FRAME_LENGTH(frame); i++) {
+    if (fec) {
+      uint8_t code[2];
+      gh_fecEncodeByte(frame[i], code);
+      stream.insert(stream.end(), code, code + 2);
+    }
+    else {
+      stream.push_back(frame[i]);
+    }
+  }
+  transmit(true, node.link, stream.data(), (int)stream.size(), delay);
+}
+
+void SimRadioChannel::nodeLink(SimNode &node)
+{
+  if ((node.linkNext != node.link) && (m_now >= node.linkAt)) {
+    node.link = node.linkNext;
+    node.lastRx = m_now;
+  }
+
+  // as the node does, when the control unit can't reach it.
+  if ((node.link != GH_LINK_ROBUST) && ((m_now - node.lastRx) > GH_LINK_FALLBACK)) {
+    node.link = GH_LINK_ROBUST;
+    node.linkNext = GH_LINK_ROBUST;
+  }
+}
+
+// as the node does, on the interval, or sooner if a reading has moved
+// by more than the delta since the last push.
+void SimRadioChannel::nodePush(SimNode &node)
+{
+  if (node.pushInterval == 0) {
+    return;
+  }
+
+  bool moved = false;
+  for (int i = 0; i < SIM_TEMP_DEVS; i++) {
+    moved = moved || (abs(node.temps[i] - node.tempsPushed[i]) > node.pushDelta);
+  }
+  if ((m_now < node.nextPush) && !moved) {
+    return;
+  }
+
+  uint8_t tx[GH_LENGTH_MAX];
+  GH_TO(tx) = GH_ADDR_MAIN;
+  GH_FROM(tx) = node.address;
+  GH_SEQ(tx) = 0;
+  GH_CMD(tx) = GH_CMD_TEMP_PUSH;
+  nodeTemps(node, tx);
+  gh_crcWrite(tx);
+  nodeTransmit(node, tx, false, 0);
+
+  memcpy(node.tempsPushed, node.temps, sizeof(node.temps));
+  node.nextPush = m_now + (node.pushInterval * 1000UL);
+  node.pushes++;
+}
+
+// as GH_CMD_TEMP_ALL_RSP.
+void SimRadioChannel::nodeTemps(SimNode &node, uint8_t *tx)
+{
+  GH_DATA_1(tx) = SIM_TEMP_DEVS;
+  for (int i = 0; i < SIM_TEMP_DEVS; i++) {
+    GH_TEMP_ALL_DATA(tx, i, 0) = (uint8_t)node.temps[i];
+    GH_TEMP_ALL_DATA(tx, i, 1) = (uint8_t)(node.temps[i] >> 8);
+  }
+  GH_LEN(tx) = GH_TEMP_ALL_LENGTH(SIM_TEMP_DEVS);
+}
+
+void SimRadioChannel::nodeCommand(SimNode &node, const uint8_t *req, uint8_t *rsp)
+{
+  rsp[0] = GH_CMD_ACK;
+  rsp[1] = req[0];
+  rsp[2] = 0;
+
+  switch (req[0]) {
+
+    case GH_CMD_HELLO:
+    case GH_CMD_TEMP_RESCAN:
+      break;
+
+    case GH_CMD_TEMP_SUB: {
+      node.pushInterval = req[1];
+      node.pushDelta = req[2];
+      node.nextPush = m_now + (req[1] * 1000UL);
+    } break;
+
+    case GH_CMD_TEMP_RES: {
+      if ((req[1] < GH_TEMP_RES_MIN) || (req[1] > GH_TEMP_RES_MAX)) {
+        rsp[0] = GH_CMD_ERROR;
+        rsp[1] = GH_ERROR_BAD_TEMP_RES;
+        break;
+      }
+      node.tempResolution = req[1];
+    } break;
+
+    case GH_CMD_MOTOR_SPEED: {
+      node.motorSpeed = req[1];
+    } break;
+
+    case GH_CMD_MOTOR_RUN: {
+      node.motorRuns++;
+    } break;
+
+    case GH_CMD_LINK: {
+      if (req[1] > GH_LINK_MAX) {
+        rsp[0] = GH_CMD_ERROR;
+        rsp[1] = GH_ERROR_BAD_LINK;
+        break;
+      }
+      node.linkNext = req[1];
+    } break;
+
+    case GH_CMD_MOTOR_STATE_REQ: {
+      rsp[0] = GH_CMD_MOTOR_STATE_RSP;
+      rsp[1] = 0;
+    } break;
+
+    default: {
+      rsp[0] = GH_CMD_ERROR;
+      rsp[1] = GH_ERROR_BAD_CMD;
+      rsp[2] = req[0];
+    } break;
+  }
+}
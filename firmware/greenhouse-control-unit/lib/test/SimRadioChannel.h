@@ -0,0 +1,122 @@
+#pragma once
+
+#include "../native/greenhouse/IRadioTransport.h"
+
+#include <gh_protocol.h>
+
+#include <deque>
+#include <random>
+#include <vector>
+
+using namespace native::greenhouse;
+
+struct SimRadioConfig {
+  float loss = 0;              // chance a frame never arrives
+  float duplicate = 0;         // chance a frame arrives twice
+  float corrupt = 0;           // chance a frame arrives with a bit flipped
+  float bitError = 0;          // chance each bit is flipped
+  float noise = 0;             // chance of a stray byte ahead of a frame
+  unsigned long latency = 10;  // one way, on top of the time on air (ms)
+  unsigned long jitter = 0;    // up to this much extra latency (ms)
+  unsigned int seed = 1;
+};
+
+// in-process stand-in for the hc-12 link and the nodes on the other end,
+// running on a virtual clock that only moves when Step is called. the
+// nodes answer as the node firmware does. frames that overlap in the air
+// don't collide. a frame is only heard on the link it was sent on.
+class SimRadioChannel : public IRadioTransport {
+
+  struct SimFrame {
+    unsigned long arrival;
+    bool toMain;
+    uint8_t link;
+    std::vector<uint8_t> data;
+  };
+
+  struct SimNode {
+    uint8_t address;
+    gh_dedupe dedupe;
+    std::vector<uint8_t> reply; // the last, to a retry (unicast or group)
+    std::vector<uint8_t> groupReply;
+    uint8_t loseReplyTo; // request command whose next reply is lost
+    int motorRuns;
+    uint8_t motorSpeed;
+    uint8_t tempResolution;
+    int16_t temps[GH_TEMP_DEVS_MAX]; // raw, as the probes read
+    int16_t tempsPushed[GH_TEMP_DEVS_MAX];
+    uint8_t pushInterval; // secs; 0 for none
+    uint8_t pushDelta;
+    unsigned long nextPush;
+    int pushes;
+    uint8_t link;
+    uint8_t linkNext;
+    unsigned long linkAt; // when linkNext takes effect
+    unsigned long lastRx;
+    unsigned long replyAt; // a group reply waits for its slot until then
+    unsigned long latency; // extra, before the node replies (ms)
+    unsigned long deafUntil; // hears nothing until then
+    float fastLoss;
+    uint8_t rxBuf[GH_LENGTH_MAX];
+    gh_parser parser;
+  };
+
+public:
+  SimRadioChannel(const SimRadioConfig &config);
+  // fastLoss is extra loss above the robust link, for a far node.
+  void AddNode(uint8_t address, float fastLoss = 0);
+  void Step(unsigned long ms = 1);
+  int MotorRuns(uint8_t address) const;
+  int MotorSpeed(uint8_t address) const;
+  int TempResolution(uint8_t address) const;
+  void Temp(uint8_t address, int dev, float temp);
+  int TempPushInterval(uint8_t address) const;
+  int TempPushDelta(uint8_t address) const;
+  int TempPushes(uint8_t address) const;
+  int NodeLink(uint8_t address) const;
+  // the node takes this much longer (ms) to reply, as a slow or far node.
+  void NodeLatency(uint8_t address, unsigned long latency);
+  // the node hears nothing for the next ms, as when something's in the way.
+  void NodeDeaf(uint8_t address, unsigned long ms);
+  // the node's next reply to cmd never arrives.
+  void LoseReply(uint8_t address, uint8_t cmd);
+  int FramesSent() const { return m_framesSent; }
+  int FramesLost() const { return m_framesLost; }
+
+  // IRadioTransport
+  unsigned long Millis() { return m_now; }
+  int Available() { return (int)m_rxBytes.size(); }
+  int Read(uint8_t *buf, int length);
+  void Write(const uint8_t *buf, int length);
+  void Link(uint8_t from, uint8_t to);
+  bool LinkDone() { return m_now >= m_linkDoneAt; }
+
+  // the control unit's module, as left before a restart (it keeps its
+  // settings).
+  void ModuleLink(uint8_t link) { m_moduleLink = link; }
+
+private:
+  bool chance(float p);
+  bool lost(const SimNode &node, uint8_t link);
+  void transmit(bool toMain, uint8_t link, const uint8_t *buf, int length, unsigned long delay);
+  void deliver(const SimFrame &frame);
+  void nodeReceive(SimNode &node, const uint8_t *rx, bool fec);
+  void nodeTransmit(SimNode &node, const uint8_t *frame, bool fec, unsigned long delay);
+  void nodeLink(SimNode &node);
+  void nodePush(SimNode &node);
+  void nodeTemps(SimNode &node, uint8_t *tx);
+  void nodeCommand(SimNode &node, const uint8_t *req, uint8_t *rsp);
+
+private:
+  SimRadioConfig m_config;
+  std::mt19937 m_random;
+  unsigned long m_now;
+  uint8_t m_link;       // control unit uart
+  uint8_t m_moduleLink; // control unit module, on air
+  unsigned long m_linkDoneAt; // deaf until then, switching
+  std::vector<SimNode> m_nodes;
+  std::vector<SimFrame> m_frames;
+  std::deque<uint8_t> m_rxBytes;
+  int m_framesSent;
+  int m_framesLost;
+};
@@ -3,3 +3,4 @@
 void testSystem();
 void testHeating();
 void testTime();
+void testRadio();
@@ -0,0 +1,1130 @@
+#include "test.h"
+
+#include "SimRadioChannel.h"
+#include "../native/greenhouse/radio/NodeRadio.h"
+
+#include <string.h>
+#include <unity.h>
+
+using namespace native::greenhouse;
+
+struct TestExchange {
+  int calls = 0;
+  bool ok = false;
+  int attempts = 0;
+};
+
+void testExchangeDone(radio::SendDesc &sendDesc, bool ok)
+{
+  TestExchange *exchange = (TestExchange *)sendDesc.okCallbackArg;
+  exchange->calls++;
+  exchange->ok = ok;
+  exchange->attempts = sendDesc.attempts;
+}
+
+void testSendHello(Radio &radio, TestExchange &exchange)
+{
+  radio::SendDesc sd;
+  sd.to = GH_ADDR_NODE_1;
+  sd.cmd = GH_CMD_HELLO;
+  sd.okCallbackArg = &exchange;
+  sd.doneCallback = &testExchangeDone;
+  radio.FindNode(GH_ADDR_NODE_1)->Send(sd);
+}
+
+// and through the boot link sweep, so the module's ready.
+void testInit(Radio &radio, SimRadioChannel &channel)
+{
+  radio.Init(channel);
+  while (radio.LinkBusy()) {
+    radio.Loop();
+    channel.Step();
+  }
+}
+
+// the window nodes, as the control unit has them.
+void testAddNodes(Radio &radio)
+{
+  radio.AddNode(GH_ADDR_NODE_1, radio::k_capMotor | radio::k_capTemps);
+  radio.AddNode(GH_ADDR_NODE_2, radio::k_capMotor);
+}
+
+void testRun(Radio &radio, SimRadioChannel &channel, unsigned long ms)
+{
+  for (unsigned long i = 0; i < ms; i++) {
+    radio.Loop();
+    channel.Step();
+  }
+}
+
+void testSendPoll(Radio &radio, uint8_t address, TestExchange &exchange)
+{
+  radio::SendDesc sd;
+  sd.to = address;
+  sd.cmd = GH_CMD_TEMP_ALL_REQ;
+  sd.expectCmd = GH_CMD_TEMP_ALL_RSP;
+  sd.priority = radio::k_priorityTelemetry;
+  sd.okCallbackArg = &exchange;
+  sd.doneCallback = &testExchangeDone;
+  radio.FindNode(address)->Send(sd);
+}
+
+// until every exchange is done, or ms is up; the time taken.
+unsigned long testRunUntilDone(
+  Radio &radio,
+  SimRadioChannel &channel,
+  const TestExchange *exchanges,
+  int count,
+  unsigned long ms)
+{
+  const unsigned long start = channel.Millis();
+  while ((channel.Millis() - start) < ms) {
+    bool done = true;
+    for (int i = 0; i < count; i++) {
+      done = done && (exchanges[i].calls != 0);
+    }
+    if (done) {
+      break;
+    }
+    radio.Loop();
+    channel.Step();
+  }
+  return channel.Millis() - start;
+}
+
+void Test_Send_CleanChannel_OkFirstAttempt(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  Radio radio;
+  testInit(radio, channel);
+  testAddNodes(radio);
+
+  TestExchange exchange;
+  testSendHello(radio, exchange);
+  testRun(radio, channel, 5000);
+
+  TEST_ASSERT_EQUAL_INT(1, exchange.calls);
+  TEST_ASSERT_EQUAL(true, exchange.ok);
+  TEST_ASSERT_EQUAL_INT(1, exchange.attempts);
+}
+
+void Test_Send_NodeMissing_FailsAfterRetryMax(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  Radio radio;
+  radio.RetryMax(3);
+  testInit(radio, channel);
+  testAddNodes(radio);
+
+  TestExchange exchange;
+  testSendHello(radio, exchange);
+  testRun(radio, channel, 20000);
+
+  TEST_ASSERT_EQUAL_INT(1, exchange.calls);
+  TEST_ASSERT_EQUAL(false, exchange.ok);
+  TEST_ASSERT_EQUAL_INT(3, exchange.attempts);
+}
+
+void Test_Send_ResponsesDuplicated_DoneOnce(void)
+{
+  SimRadioConfig config;
+  config.duplicate = 1;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  Radio radio;
+  testInit(radio, channel);
+  testAddNodes(radio);
+
+  TestExchange exchange;
+  testSendHello(radio, exchange);
+  testRun(radio, channel, 5000);
+
+  TEST_ASSERT_EQUAL_INT(1, exchange.calls);
+  TEST_ASSERT_EQUAL(true, exchange.ok);
+}
+
+void Test_MotorRunAll_FramesDuplicated_EachNodeRunsOnce(void)
+{
+  SimRadioConfig config;
+  config.duplicate = 1;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  channel.AddNode(GH_ADDR_NODE_2);
+  Radio radio;
+  testInit(radio, channel);
+  testAddNodes(radio);
+
+  radio.MotorRunAll(radio::k_windowExtend, 10);
+  testRun(radio, channel, 5000);
+
+  TEST_ASSERT_EQUAL_INT(1, channel.MotorRuns(GH_ADDR_NODE_1));
+  TEST_ASSERT_EQUAL_INT(1, channel.MotorRuns(GH_ADDR_NODE_2));
+}
+
+void Test_MotorRunAll_GroupAckLostThenUnicast_RetryGetsReplay(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  channel.AddNode(GH_ADDR_NODE_2);
+  Radio radio;
+  testInit(radio, channel);
+  testAddNodes(radio);
+  testRun(radio, channel, 1000);
+
+  // the poll reaches the node before the group retry does.
+  channel.LoseReply(GH_ADDR_NODE_1, GH_CMD_MOTOR_RUN);
+  radio.MotorRunAll(radio::k_windowExtend, 10);
+  radio.FindNode(GH_ADDR_NODE_1)->RequestTemps();
+  testRun(radio, channel, 5000);
+
+  radio::Node &node = *radio.FindNode(GH_ADDR_NODE_1);
+  TEST_ASSERT_EQUAL_INT(1, channel.MotorRuns(GH_ADDR_NODE_1));
+  TEST_ASSERT_EQUAL_INT(1, node.Stats().counts[radio::k_statsMotorRun][radio::k_statsOk]);
+  TEST_ASSERT_EQUAL_INT(0, node.Stats().counts[radio::k_statsMotorRun][radio::k_statsFailed]);
+  TEST_ASSERT_EQUAL_INT(1, node.Stats().counts[radio::k_statsTemps][radio::k_statsOk]);
+}
+
+void Test_MotorRunAll_UnicastSameSeqInFlight_NotTakenForGroupAck(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  channel.AddNode(GH_ADDR_NODE_2);
+  Radio radio;
+  testInit(radio, channel);
+  testAddNodes(radio);
+  testRun(radio, channel, 1000);
+  radio.MotorRunAll(radio::k_windowExtend, 10);
+  testRun(radio, channel, 1000);
+
+  // the group and the right window count from the same number now. the
+  // window drops the speed while its group ack waits for its slot.
+  TestExchange exchange;
+  radio::SendDesc sd;
+  sd.to = GH_ADDR_NODE_2;
+  sd.cmd = GH_CMD_MOTOR_SPEED;
+  sd.data1 = 150;
+  sd.okCallbackArg = &exchange;
+  sd.doneCallback = &testExchangeDone;
+  radio.MotorRunAll(radio::k_windowExtend, 10);
+  radio.FindNode(GH_ADDR_NODE_2)->Send(sd);
+  testRun(radio, channel, 3000);
+
+  TEST_ASSERT_EQUAL(true, exchange.ok);
+  TEST_ASSERT_EQUAL_INT(2, exchange.attempts);
+  TEST_ASSERT_EQUAL_INT(150, channel.MotorSpeed(GH_ADDR_NODE_2));
+  TEST_ASSERT_EQUAL_INT(2, channel.MotorRuns(GH_ADDR_NODE_2));
+}
+
+void Test_Send_NodeRepliesError_FailsWithoutRetry(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  Radio radio;
+  testInit(radio, channel);
+  testAddNodes(radio);
+  testRun(radio, channel, 1000);
+
+  TestExchange exchange;
+  radio::SendDesc sd;
+  sd.to = GH_ADDR_NODE_1;
+  sd.cmd = GH_CMD_TEMP_RES;
+  sd.data1 = GH_TEMP_RES_MAX + 1;
+  sd.okCallbackArg = &exchange;
+  sd.doneCallback = &testExchangeDone;
+  radio::Node &node = *radio.FindNode(GH_ADDR_NODE_1);
+  node.Send(sd);
+  testRun(radio, channel, 200);
+
+  TEST_ASSERT_EQUAL_INT(1, exchange.calls);
+  TEST_ASSERT_EQUAL(false, exchange.ok);
+  TEST_ASSERT_EQUAL_INT(1, exchange.attempts);
+  TEST_ASSERT_EQUAL(true, node.Online());
+}
+
+void Test_Send_NodeMissing_CountsAttemptsAndTimeouts(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  Radio radio;
+  radio.RetryMax(3);
+  testInit(radio, channel);
+  testAddNodes(radio);
+
+  TestExchange exchange;
+  testSendHello(radio, exchange);
+  testRun(radio, channel, 20000);
+
+  // the node's own hello, sent on init, failed too.
+  const radio::NodeStats &stats = radio.FindNode(GH_ADDR_NODE_1)->Stats();
+  TEST_ASSERT_EQUAL_INT(6, stats.counts[radio::k_statsHello][radio::k_statsAttempts]);
+  TEST_ASSERT_EQUAL_INT(6, stats.counts[radio::k_statsHello][radio::k_statsTimeouts]);
+  TEST_ASSERT_EQUAL_INT(2, stats.counts[radio::k_statsHello][radio::k_statsFailed]);
+  TEST_ASSERT_EQUAL_INT(0, stats.counts[radio::k_statsHello][radio::k_statsOk]);
+}
+
+void Test_RttHistogram_Percentile_BucketUpperBoundOrMax(void)
+{
+  radio::RttHistogram rtt;
+  for (int i = 0; i < 90; i++) {
+    rtt.Add(40);
+  }
+  for (int i = 0; i < 10; i++) {
+    rtt.Add(700);
+  }
+
+  TEST_ASSERT_EQUAL_INT(50, rtt.Percentile(50));
+  TEST_ASSERT_EQUAL_INT(700, rtt.Percentile(95)); // capped at max
+  TEST_ASSERT_EQUAL_INT(700, rtt.Max());
+}
+
+void Test_MotorRun_SpeedSet_SpeedAndRunInOneExchange(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  Radio radio;
+  testInit(radio, channel);
+  testAddNodes(radio);
+  testRun(radio, channel, 1000);
+
+  radio::Node &node = *radio.FindNode(GH_ADDR_NODE_1);
+  node.MotorSpeed(150);
+  testRun(radio, channel, 1000);
+
+  const int framesSent = channel.FramesSent();
+  node.MotorRun(radio::k_windowExtend, 10);
+  testRun(radio, channel, 1000);
+
+  // one request and one response.
+  TEST_ASSERT_EQUAL_INT(2, channel.FramesSent() - framesSent);
+  TEST_ASSERT_EQUAL_INT(150, channel.MotorSpeed(GH_ADDR_NODE_1));
+  TEST_ASSERT_EQUAL_INT(1, channel.MotorRuns(GH_ADDR_NODE_1));
+  TEST_ASSERT_EQUAL_INT(1, node.Stats().counts[radio::k_statsBatch][radio::k_statsOk]);
+}
+
+void Test_KeepAlive_PolledNode_NoExtraHello(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  Radio radio;
+  radio.KeepAliveIdle(60000);
+  testInit(radio, channel);
+  testAddNodes(radio);
+
+  radio::Node &node = *radio.FindNode(GH_ADDR_NODE_1);
+  for (int i = 0; i < 10; i++) {
+    node.RequestTemps();
+    for (int j = 0; j < 20; j++) {
+      radio.Update();
+      testRun(radio, channel, 1000);
+    }
+  }
+
+  // only the hello sent on init; the polls keep the link alive.
+  TEST_ASSERT_EQUAL(true, node.Online());
+  TEST_ASSERT_EQUAL_INT(1, node.Stats().counts[radio::k_statsHello][radio::k_statsAttempts]);
+}
+
+void Test_Send_NoiseBeforeFrames_OkFirstAttempt(void)
+{
+  SimRadioConfig config;
+  config.noise = 1;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  Radio radio;
+  testInit(radio, channel);
+  testAddNodes(radio);
+  testRun(radio, channel, 1000);
+
+  // a stray byte ahead of each frame shouldn't cost a retry.
+  for (int i = 0; i < 20; i++) {
+    TestExchange exchange;
+    testSendHello(radio, exchange);
+    testRun(radio, channel, 1000);
+
+    TEST_ASSERT_EQUAL_INT(1, exchange.calls);
+    TEST_ASSERT_EQUAL(true, exchange.ok);
+    TEST_ASSERT_EQUAL_INT(1, exchange.attempts);
+  }
+}
+
+void Test_Parse_FalseMarker_ResyncsToFrame(void)
+{
+  uint8_t frame[GH_LENGTH_MAX];
+  GH_LEN(frame) = GH_PAYLOAD_DEFAULT;
+  GH_TO(frame) = GH_ADDR_MAIN;
+  GH_FROM(frame) = GH_ADDR_NODE_1;
+  GH_CMD(frame) = GH_CMD_ACK;
+  GH_SEQ(frame) = 7;
+  GH_DATA_1(frame) = GH_CMD_HELLO;
+  GH_DATA_2(frame) = 0;
+  gh_crcWrite(frame);
+
+  // noise that looks like a marker, then a real one.
+  uint8_t stream[3 + GH_LENGTH_MAX] = { 0x00, GH_SOF, GH_SOF };
+  memcpy(stream + 3, frame, GH_FRAME_LENGTH(frame));
+
+  uint8_t buf[GH_LENGTH_MAX];
+  gh_parser parser;
+  gh_parseInit(&parser, buf);
+  int frames = 0;
+  for (int i = 0; i < 3 + GH_FRAME_LENGTH(frame); i++) {
+    if (gh_parse(&parser, stream[i]) == GH_PARSE_FRAME) {
+      frames++;
+    }
+  }
+
+  TEST_ASSERT_EQUAL_INT(1, frames);
+  TEST_ASSERT_EQUAL_INT(7, GH_SEQ(buf));
+}
+
+// a request, as the node takes it; true if it's already been seen.
+bool testDedupe(gh_dedupe &dedupe, uint8_t key, uint8_t seq, bool hello = false)
+{
+  return gh_dedupeSeen(gh_dedupeFind(&dedupe, key, seq), seq, hello);
+}
+
+void Test_Dedupe_OutOfOrder_EachSeenOnce(void)
+{
+  gh_dedupe dedupe;
+  gh_dedupeInit(&dedupe);
+
+  const uint8_t order[] = {5, 7, 6, 9, 8};
+  for (uint8_t seq : order) {
+    TEST_ASSERT_EQUAL(false, testDedupe(dedupe, GH_ADDR_MAIN, seq));
+  }
+  const uint8_t again[] = {6, 9, 5, 7, 8};
+  for (uint8_t seq : again) {
+    TEST_ASSERT_EQUAL(true, testDedupe(dedupe, GH_ADDR_MAIN, seq));
+  }
+}
+
+void Test_Dedupe_OldSeqAgain_SeenButOnlyLastReplayed(void)
+{
+  gh_dedupe dedupe;
+  gh_dedupeInit(&dedupe);
+  for (uint8_t seq = 10; seq <= 20; seq++) {
+    gh_dedupeWindow *window = gh_dedupeFind(&dedupe, GH_ADDR_MAIN, seq);
+    TEST_ASSERT_EQUAL(false, gh_dedupeSeen(window, seq, false));
+    gh_dedupeHandled(window, GH_CMD_TEMP_ALL_REQ, seq);
+  }
+
+  // a late copy of an older request is dropped; the last is a retry.
+  gh_dedupeWindow *window = gh_dedupeFind(&dedupe, GH_ADDR_MAIN, 12);
+  TEST_ASSERT_EQUAL(true, gh_dedupeSeen(window, 12, false));
+  TEST_ASSERT_EQUAL(false, gh_dedupeIsLast(window, GH_CMD_TEMP_ALL_REQ, 12));
+  TEST_ASSERT_EQUAL(true, gh_dedupeSeen(window, 20, false));
+  TEST_ASSERT_EQUAL(true, gh_dedupeIsLast(window, GH_CMD_TEMP_ALL_REQ, 20));
+  TEST_ASSERT_EQUAL(false, gh_dedupeIsLast(window, GH_CMD_MOTOR_RUN, 20));
+
+  // further back than the window remembers; taken as new.
+  TEST_ASSERT_EQUAL(false, testDedupe(dedupe, GH_ADDR_MAIN, 20 - GH_DEDUPE_BITS));
+}
+
+void Test_Dedupe_TwoSenders_WindowEach(void)
+{
+  gh_dedupe dedupe;
+  gh_dedupeInit(&dedupe);
+
+  gh_dedupeWindow *unicast = gh_dedupeFind(&dedupe, GH_ADDR_MAIN, 5);
+  TEST_ASSERT_EQUAL(false, gh_dedupeSeen(unicast, 5, false));
+  gh_dedupeHandled(unicast, GH_CMD_TEMP_ALL_REQ, 5);
+  gh_dedupeWindow *group = gh_dedupeFind(&dedupe, GH_ADDR_WINDOWS, GH_SEQ_GROUP | 5);
+  TEST_ASSERT_EQUAL(false, gh_dedupeSeen(group, GH_SEQ_GROUP | 5, false));
+  gh_dedupeHandled(group, GH_CMD_MOTOR_RUN, GH_SEQ_GROUP | 5);
+
+  // a unicast request in between doesn't lose the group's last reply.
+  TEST_ASSERT_EQUAL(false, testDedupe(dedupe, GH_ADDR_MAIN, 6));
+  TEST_ASSERT_EQUAL(true, testDedupe(dedupe, GH_ADDR_WINDOWS, GH_SEQ_GROUP | 5));
+  TEST_ASSERT_EQUAL(true, gh_dedupeIsLast(group, GH_CMD_MOTOR_RUN, GH_SEQ_GROUP | 5));
+  TEST_ASSERT_EQUAL(true, testDedupe(dedupe, GH_ADDR_MAIN, 5));
+  TEST_ASSERT_EQUAL(false, testDedupe(dedupe, GH_ADDR_WINDOWS, GH_SEQ_GROUP | 6));
+
+  // a third sender takes the oldest window.
+  TEST_ASSERT_EQUAL(false, testDedupe(dedupe, GH_ADDR_NODE_2, 5));
+  TEST_ASSERT_EQUAL(false, testDedupe(dedupe, GH_ADDR_MAIN, 5));
+}
+
+void Test_Dedupe_SeqWraps_NewAfterWrapOldStillSeen(void)
+{
+  gh_dedupe dedupe;
+  gh_dedupeInit(&dedupe);
+
+  const uint8_t unicast[] = {0x7D, 0x7E, 0x7F, 0x00, 0x01};
+  for (uint8_t seq : unicast) {
+    TEST_ASSERT_EQUAL(false, testDedupe(dedupe, GH_ADDR_MAIN, seq));
+  }
+  TEST_ASSERT_EQUAL(true, testDedupe(dedupe, GH_ADDR_MAIN, 0x7F));
+  TEST_ASSERT_EQUAL(true, testDedupe(dedupe, GH_ADDR_MAIN, 0x00));
+
+  const uint8_t group[] = {0xFE, 0xFF, GH_SEQ_GROUP};
+  for (uint8_t seq : group) {
+    TEST_ASSERT_EQUAL(false, testDedupe(dedupe, GH_ADDR_WINDOWS, seq));
+  }
+  TEST_ASSERT_EQUAL(true, testDedupe(dedupe, GH_ADDR_WINDOWS, 0xFF));
+}
+
+void Test_Dedupe_HelloAfterRestart_StartsAgain(void)
+{
+  gh_dedupe dedupe;
+  gh_dedupeInit(&dedupe);
+  for (uint8_t seq = 1; seq <= 30; seq++) {
+    testDedupe(dedupe, GH_ADDR_MAIN, seq);
+  }
+
+  // the sender restarted, and counts from 1 again.
+  TEST_ASSERT_EQUAL(false, testDedupe(dedupe, GH_ADDR_MAIN, 1, true));
+  TEST_ASSERT_EQUAL(false, testDedupe(dedupe, GH_ADDR_MAIN, 2));
+  TEST_ASSERT_EQUAL(true, testDedupe(dedupe, GH_ADDR_MAIN, 1));
+}
+
+void Test_AddNode_ManyNodes_AllComeOnline(void)
+{
+  const int nodes = 24;
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  Radio radio;
+  testInit(radio, channel);
+  for (int i = 0; i < nodes; i++) {
+    channel.AddNode(GH_ADDR_NODE_1 + i);
+    radio.AddNode(GH_ADDR_NODE_1 + i, radio::k_capTemps);
+  }
+
+  // more hellos than the send queue holds; the rest are sent as the
+  // nodes take their turn in Update.
+  for (int i = 0; i < 120; i++) {
+    radio.Update();
+    testRun(radio, channel, 1000);
+  }
+
+  TEST_ASSERT_EQUAL_INT(nodes, radio.NodeCount());
+  for (int i = 0; i < nodes; i++) {
+    TEST_ASSERT_EQUAL(true, radio.Node(i).Online());
+  }
+}
+
+void Test_Send_FecOneBitFlippedPerFrame_OkFirstAttempt(void)
+{
+  SimRadioConfig config;
+  config.corrupt = 1;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  Radio radio;
+  testInit(radio, channel);
+  radio::Node &node = *radio.AddNode(GH_ADDR_NODE_1, radio::k_capTemps);
+  node.Fec(true);
+  testRun(radio, channel, 1000);
+
+  TestExchange exchange;
+  testSendHello(radio, exchange);
+  testRun(radio, channel, 1000);
+
+  TEST_ASSERT_EQUAL(true, exchange.ok);
+  TEST_ASSERT_EQUAL_INT(1, exchange.attempts);
+  TEST_ASSERT_EQUAL_INT(2, node.Stats().fecCorrected); // both responses
+}
+
+void Test_Link_FarNodeLosesFrames_NearNodeFastFarNodeRobust(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  channel.AddNode(GH_ADDR_NODE_2, 0.5);
+  Radio radio;
+  testInit(radio, channel);
+  testAddNodes(radio);
+
+  radio::Node &nearNode = *radio.FindNode(GH_ADDR_NODE_1);
+  radio::Node &farNode = *radio.FindNode(GH_ADDR_NODE_2);
+  nearNode.LinkMax(GH_LINK_FAST);
+  farNode.LinkMax(GH_LINK_FAST);
+
+  // 5 minutes, polling every 5s.
+  for (int i = 0; i < 60; i++) {
+    nearNode.RequestTemps();
+    farNode.RequestTemps();
+    for (int j = 0; j < 5; j++) {
+      radio.Update();
+      testRun(radio, channel, 1000);
+    }
+  }
+
+  TEST_ASSERT_EQUAL_INT(GH_LINK_FAST, nearNode.Link());
+  TEST_ASSERT_EQUAL_INT(GH_LINK_FAST, channel.NodeLink(GH_ADDR_NODE_1));
+  TEST_ASSERT_EQUAL(true, farNode.Stats().counts[radio::k_statsLink][radio::k_statsOk] > 0);
+  TEST_ASSERT_EQUAL_INT(GH_LINK_ROBUST, farNode.Link());
+  TEST_ASSERT_EQUAL_INT(GH_LINK_ROBUST, channel.NodeLink(GH_ADDR_NODE_2));
+  TEST_ASSERT_EQUAL(true, nearNode.Online());
+  TEST_ASSERT_EQUAL(true, farNode.Online());
+}
+
+// a poll every 5s, as the control unit does.
+void testRunPolls(Radio &radio, SimRadioChannel &channel, radio::Node &node, int seconds)
+{
+  for (int i = 0; i < seconds; i++) {
+    if ((i % 5) == 0) {
+      node.RequestTemps();
+    }
+    radio.Update();
+    testRun(radio, channel, 1000);
+  }
+}
+
+void Test_Link_OneExchangeFailsOnFast_StaysFast(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  Radio radio;
+  testInit(radio, channel);
+  radio.AddNode(GH_ADDR_NODE_1, radio::k_capTemps);
+  radio::Node &node = *radio.FindNode(GH_ADDR_NODE_1);
+  node.LinkMax(GH_LINK_FAST);
+  testRunPolls(radio, channel, node, 300);
+  TEST_ASSERT_EQUAL_INT(GH_LINK_FAST, node.Link());
+
+  // every attempt lost (the last is sent after 2250ms), and heard again
+  // well before the node would fall back.
+  const unsigned long hellos = node.Stats().counts[radio::k_statsHello][radio::k_statsAttempts];
+  channel.NodeDeaf(GH_ADDR_NODE_1, 3000);
+  TestExchange exchange;
+  testSendPoll(radio, GH_ADDR_NODE_1, exchange);
+  testRunUntilDone(radio, channel, &exchange, 1, 20000);
+  TEST_ASSERT_EQUAL(false, exchange.ok);
+
+  testRunPolls(radio, channel, node, 60);
+  TEST_ASSERT_EQUAL_INT(GH_LINK_FAST, node.Link());
+  TEST_ASSERT_EQUAL_INT(GH_LINK_FAST, channel.NodeLink(GH_ADDR_NODE_1));
+  TEST_ASSERT_EQUAL(hellos, node.Stats().counts[radio::k_statsHello][radio::k_statsAttempts]);
+  TEST_ASSERT_EQUAL(true, node.Online());
+}
+
+void Test_Link_NodeGoneOnFast_FallsBackAndReconnects(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  Radio radio;
+  testInit(radio, channel);
+  radio.AddNode(GH_ADDR_NODE_1, radio::k_capTemps);
+  radio::Node &node = *radio.FindNode(GH_ADDR_NODE_1);
+  node.LinkMax(GH_LINK_FAST);
+  testRunPolls(radio, channel, node, 300);
+  TEST_ASSERT_EQUAL_INT(GH_LINK_FAST, node.Link());
+
+  // long enough for the node to fall back by itself.
+  channel.NodeDeaf(GH_ADDR_NODE_1, 40000);
+  testRunPolls(radio, channel, node, 40);
+  TEST_ASSERT_EQUAL_INT(GH_LINK_ROBUST, node.Link());
+
+  testRunPolls(radio, channel, node, 120);
+  TEST_ASSERT_EQUAL_INT(GH_LINK_ROBUST, node.Link());
+  TEST_ASSERT_EQUAL_INT(GH_LINK_ROBUST, channel.NodeLink(GH_ADDR_NODE_1));
+  TEST_ASSERT_EQUAL(true, node.Online());
+}
+
+void Test_Link_RestartWithModuleOnFast_BackToRobust(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  channel.ModuleLink(GH_LINK_FAST);
+  Radio radio;
+  testInit(radio, channel);
+  testAddNodes(radio);
+  testRun(radio, channel, 1000);
+
+  TEST_ASSERT_EQUAL(true, radio.FindNode(GH_ADDR_NODE_1)->Online());
+}
+
+void Test_Link_NodesOnDifferentLinks_SwitchDoesNotHoldLoop(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  channel.AddNode(GH_ADDR_NODE_2);
+  Radio radio;
+  testInit(radio, channel);
+  testAddNodes(radio);
+  radio::Node &fastNode = *radio.FindNode(GH_ADDR_NODE_1);
+  fastNode.LinkMax(GH_LINK_FAST);
+  testRunPolls(radio, channel, fastNode, 300);
+  TEST_ASSERT_EQUAL_INT(GH_LINK_FAST, fastNode.Link());
+  TEST_ASSERT_EQUAL_INT(GH_LINK_ROBUST, radio.FindNode(GH_ADDR_NODE_2)->Link());
+
+  // one poll each, so the module switches at least once; the clock only
+  // moves between loops.
+  TestExchange exchanges[2];
+  testSendPoll(radio, GH_ADDR_NODE_1, exchanges[0]);
+  testSendPoll(radio, GH_ADDR_NODE_2, exchanges[1]);
+  bool switched = false;
+  for (int i = 0; (i < 5000) && ((exchanges[0].calls == 0) || (exchanges[1].calls == 0)); i++) {
+    const unsigned long before = channel.Millis();
+    radio.Loop();
+    TEST_ASSERT_EQUAL(before, channel.Millis());
+    switched = switched || radio.LinkBusy();
+    channel.Step();
+  }
+
+  TEST_ASSERT_EQUAL(true, switched);
+  TEST_ASSERT_EQUAL(true, exchanges[0].ok);
+  TEST_ASSERT_EQUAL(true, exchanges[1].ok);
+  TEST_ASSERT_EQUAL_INT(1, exchanges[0].attempts);
+  TEST_ASSERT_EQUAL_INT(1, exchanges[1].attempts);
+}
+
+void Test_Reconnect_NodeMissing_HelloBacksOffUntilNodeBack(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  Radio radio;
+  testInit(radio, channel);
+  testAddNodes(radio);
+
+  // 30 minutes with the left window missing; every 10s would be 180
+  // hellos of up to 5 attempts each.
+  radio::Node &node = *radio.FindNode(GH_ADDR_NODE_2);
+  for (int i = 0; i < 1800; i++) {
+    radio.Update();
+    testRun(radio, channel, 1000);
+  }
+
+  const unsigned long attempts = node.Stats().counts[radio::k_statsHello][radio::k_statsAttempts];
+  TEST_ASSERT_EQUAL(false, node.Online());
+  TEST_ASSERT_EQUAL(true, attempts <= 30);
+
+  // back within the capped delay.
+  channel.AddNode(GH_ADDR_NODE_2);
+  for (int i = 0; i < 600; i++) {
+    radio.Update();
+    testRun(radio, channel, 1000);
+  }
+
+  TEST_ASSERT_EQUAL(true, node.Online());
+  TEST_ASSERT_EQUAL(true, radio.FindNode(GH_ADDR_NODE_1)->Online());
+}
+
+void Test_DutyCycle_KeepAliveFlood_HeldToBudget(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  channel.AddNode(GH_ADDR_NODE_2);
+  Radio radio;
+  radio.KeepAliveIdle(100);
+  radio.DutyCycleMax(0.02f);
+  testInit(radio, channel);
+  testAddNodes(radio);
+
+  // unchecked, a hello every 100ms to each node is over 10% of the air.
+  float peak = 0;
+  for (int i = 0; i < 120000; i++) {
+    radio.Update();
+    radio.Loop();
+    channel.Step();
+    if (radio.Utilisation() > peak) {
+      peak = radio.Utilisation();
+    }
+  }
+
+  // up to the budget, and over only by the frames already in flight.
+  TEST_ASSERT_EQUAL(true, peak > 0.015f);
+  TEST_ASSERT_EQUAL(true, peak < 0.025f);
+
+  // other requests aren't held back.
+  TestExchange exchange;
+  testSendHello(radio, exchange);
+  testRun(radio, channel, 1000);
+
+  TEST_ASSERT_EQUAL(true, exchange.ok);
+  TEST_ASSERT_EQUAL_INT(1, exchange.attempts);
+}
+
+void Test_Queue_SlotsFullOfPolls_SafetyRunStartsAtOnce(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  channel.AddNode(GH_ADDR_NODE_2);
+  Radio radio;
+  testInit(radio, channel);
+  testAddNodes(radio);
+  testRun(radio, channel, 1000);
+
+  // probes that don't answer, so their polls hold on to their slots
+  // through every retry.
+  const int probes = 12;
+  for (int i = 0; i < probes; i++) {
+    radio::Node &probe = *radio.AddNode(GH_ADDR_NODE_1 + 2 + i, radio::k_capTemps);
+    radio::SendDesc sd;
+    sd.to = probe.Address();
+    sd.cmd = GH_CMD_TEMP_ALL_REQ;
+    sd.priority = radio::k_priorityTelemetry;
+    probe.Send(sd);
+  }
+  testRun(radio, channel, 10);
+
+  radio.MotorRunAll(radio::k_windowRetract, 10, radio::k_prioritySafety);
+  testRun(radio, channel, 300);
+
+  TEST_ASSERT_EQUAL_INT(1, channel.MotorRuns(GH_ADDR_NODE_1));
+  TEST_ASSERT_EQUAL_INT(1, channel.MotorRuns(GH_ADDR_NODE_2));
+}
+
+void Test_Poll_TwoNodesDifferentLatency_CycleTakesSlowest(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  channel.AddNode(GH_ADDR_NODE_2);
+  channel.NodeLatency(GH_ADDR_NODE_1, 100);
+  channel.NodeLatency(GH_ADDR_NODE_2, 250);
+  Radio radio;
+  testInit(radio, channel);
+  testAddNodes(radio);
+  testRun(radio, channel, 2000);
+
+  TestExchange fast;
+  testSendPoll(radio, GH_ADDR_NODE_1, fast);
+  const unsigned long fastTime = testRunUntilDone(radio, channel, &fast, 1, 2000);
+  TestExchange slow;
+  testSendPoll(radio, GH_ADDR_NODE_2, slow);
+  const unsigned long slowTime = testRunUntilDone(radio, channel, &slow, 1, 2000);
+
+  // both in flight at once, so the slow node doesn't wait for the fast.
+  TestExchange both[2];
+  testSendPoll(radio, GH_ADDR_NODE_1, both[0]);
+  testSendPoll(radio, GH_ADDR_NODE_2, both[1]);
+  const unsigned long bothTime = testRunUntilDone(radio, channel, both, 2, 2000);
+
+  TEST_ASSERT_EQUAL(true, both[0].ok && both[1].ok);
+  TEST_ASSERT_EQUAL_INT(1, both[0].attempts);
+  TEST_ASSERT_EQUAL_INT(1, both[1].attempts);
+  TEST_ASSERT_EQUAL(true, bothTime <= slowTime + 5);
+  TEST_ASSERT_EQUAL(true, bothTime < slowTime + fastTime);
+}
+
+void Test_Queue_TelemetryFillsInFlight_ActuationSlotsFree(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  channel.AddNode(GH_ADDR_NODE_2);
+  Radio radio;
+  testInit(radio, channel);
+  testAddNodes(radio);
+  testRun(radio, channel, 1000);
+
+  // probes that don't answer, more than there are slots.
+  const int probes = RADIO_IN_FLIGHT_MAX + 2;
+  TestExchange polls[probes];
+  for (int i = 0; i < probes; i++) {
+    radio.AddNode(GH_ADDR_NODE_1 + 2 + i, radio::k_capTemps);
+    testSendPoll(radio, GH_ADDR_NODE_1 + 2 + i, polls[i]);
+  }
+  testRun(radio, channel, 10);
+
+  int started = 0;
+  for (int i = 0; i < probes; i++) {
+    const radio::NodeStats &stats = radio.FindNode(GH_ADDR_NODE_1 + 2 + i)->Stats();
+    if (stats.counts[radio::k_statsTemps][radio::k_statsAttempts] != 0) {
+      started++;
+    }
+  }
+  TEST_ASSERT_EQUAL_INT(RADIO_IN_FLIGHT_MAX - RADIO_IN_FLIGHT_RESERVED, started);
+
+  // a run to each window, in the slots the polls can't have.
+  radio.FindNode(GH_ADDR_NODE_1)->MotorRun(radio::k_windowExtend, 10);
+  radio.FindNode(GH_ADDR_NODE_2)->MotorRun(radio::k_windowExtend, 10);
+  testRun(radio, channel, 300);
+
+  TEST_ASSERT_EQUAL_INT(1, channel.MotorRuns(GH_ADDR_NODE_1));
+  TEST_ASSERT_EQUAL_INT(1, channel.MotorRuns(GH_ADDR_NODE_2));
+}
+
+void Test_Queue_PollPastDeadline_DroppedUnsent(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  Radio radio;
+  testInit(radio, channel);
+  radio::Node &node = *radio.AddNode(GH_ADDR_NODE_1, radio::k_capTemps);
+  testRun(radio, channel, 10);
+
+  // queued behind the hello to a node that doesn't answer.
+  TestExchange exchange;
+  radio::SendDesc sd;
+  sd.to = GH_ADDR_NODE_1;
+  sd.cmd = GH_CMD_TEMP_ALL_REQ;
+  sd.priority = radio::k_priorityTelemetry;
+  sd.deadline = 1000;
+  sd.okCallbackArg = &exchange;
+  sd.doneCallback = &testExchangeDone;
+  node.Send(sd);
+  testRun(radio, channel, 2000);
+
+  TEST_ASSERT_EQUAL_INT(1, exchange.calls);
+  TEST_ASSERT_EQUAL(false, exchange.ok);
+  TEST_ASSERT_EQUAL_INT(0, exchange.attempts);
+  TEST_ASSERT_EQUAL_INT(1, node.Stats().counts[radio::k_statsTemps][radio::k_statsExpired]);
+}
+
+void Test_TempResolution_SetBeforeOnline_SentWithHello(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  Radio radio;
+  testInit(radio, channel);
+  radio::Node &node = *radio.AddNode(GH_ADDR_NODE_1, radio::k_capTemps);
+
+  TEST_ASSERT_EQUAL(false, node.TempResolution(GH_TEMP_RES_MAX + 1));
+  TEST_ASSERT_EQUAL(true, node.TempResolution(10));
+  testRun(radio, channel, 1000);
+
+  TEST_ASSERT_EQUAL(true, node.Online());
+  TEST_ASSERT_EQUAL_INT(10, channel.TempResolution(GH_ADDR_NODE_1));
+}
+
+void Test_TempStats_TwoDevicesOneUnread_StatsInOneExchange(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  Radio radio;
+  testInit(radio, channel);
+  radio::Node &node = *radio.AddNode(GH_ADDR_NODE_1, radio::k_capTemps);
+  testRun(radio, channel, 1000);
+
+  const int framesSent = channel.FramesSent();
+  node.RequestTempStats();
+  testRun(radio, channel, 1000);
+
+  radio::TempStatsData data;
+  TEST_ASSERT_EQUAL(true, node.TempStats(data));
+  TEST_ASSERT_EQUAL_INT(2, channel.FramesSent() - framesSent);
+  TEST_ASSERT_EQUAL_INT(2, data.devs);
+  TEST_ASSERT_EQUAL_FLOAT(20.5f, data.stats[0].min);
+  TEST_ASSERT_EQUAL_FLOAT(21.0f, data.stats[0].max);
+  TEST_ASSERT_EQUAL_FLOAT(20.75f, data.stats[0].mean);
+  TEST_ASSERT_EQUAL_INT(5, data.stats[0].age);
+  TEST_ASSERT_EQUAL_FLOAT(common::k_unknown, data.stats[1].mean);
+  TEST_ASSERT_EQUAL_INT(1, node.Stats().counts[radio::k_statsTempStats][radio::k_statsOk]);
+}
+
+void testRunUpdate(Radio &radio, SimRadioChannel &channel, int seconds)
+{
+  for (int i = 0; i < seconds; i++) {
+    radio.Update();
+    testRun(radio, channel, 1000);
+  }
+}
+
+void Test_TempPush_Subscribed_TempsUpdateWithoutPolls(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  Radio radio;
+  testInit(radio, channel);
+  radio::Node &node = *radio.AddNode(GH_ADDR_NODE_1, radio::k_capTemps);
+  node.SubscribeTemps(5, 0.5f);
+  testRunUpdate(radio, channel, 10);
+
+  const unsigned long polls = node.Stats().counts[radio::k_statsTemps][radio::k_statsAttempts];
+  const int pushes = channel.TempPushes(GH_ADDR_NODE_1);
+  channel.Temp(GH_ADDR_NODE_1, 0, 25.0f);
+  testRunUpdate(radio, channel, 12);
+
+  radio::TempData data;
+  TEST_ASSERT_EQUAL(true, node.Temps(data));
+  TEST_ASSERT_EQUAL_INT(2, data.devs);
+  TEST_ASSERT_EQUAL_FLOAT(25.0f, data.temps[0]);
+  TEST_ASSERT_EQUAL_FLOAT(21.0f, data.temps[1]);
+  TEST_ASSERT_EQUAL(true, channel.TempPushes(GH_ADDR_NODE_1) > pushes);
+  TEST_ASSERT_EQUAL_INT(polls, node.Stats().counts[radio::k_statsTemps][radio::k_statsAttempts]);
+}
+
+void Test_TempPush_SubscribeDelta_SmallMoveWaitsLargeMovePushed(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  Radio radio;
+  testInit(radio, channel);
+  radio::Node &node = *radio.AddNode(GH_ADDR_NODE_1, radio::k_capTemps);
+  node.SubscribeTemps(60, 1.0f);
+  testRunUpdate(radio, channel, 2);
+
+  TEST_ASSERT_EQUAL_INT(60, channel.TempPushInterval(GH_ADDR_NODE_1));
+  TEST_ASSERT_EQUAL_INT(GH_TEMP_DELTA_SCALE, channel.TempPushDelta(GH_ADDR_NODE_1));
+
+  // within the delta; waits for the interval.
+  const int pushes = channel.TempPushes(GH_ADDR_NODE_1);
+  channel.Temp(GH_ADDR_NODE_1, 0, 21.0f);
+  testRunUpdate(radio, channel, 10);
+
+  radio::TempData data;
+  TEST_ASSERT_EQUAL_INT(pushes, channel.TempPushes(GH_ADDR_NODE_1));
+  TEST_ASSERT_EQUAL(true, node.Temps(data));
+  TEST_ASSERT_EQUAL_FLOAT(20.5f, data.temps[0]);
+
+  // past it; pushed at once.
+  channel.Temp(GH_ADDR_NODE_1, 0, 22.5f);
+  testRunUpdate(radio, channel, 1);
+
+  TEST_ASSERT_EQUAL_INT(pushes + 1, channel.TempPushes(GH_ADDR_NODE_1));
+  TEST_ASSERT_EQUAL(true, node.Temps(data));
+  TEST_ASSERT_EQUAL_FLOAT(22.5f, data.temps[0]);
+
+  // more than a byte of raw units; held at the most the node can take.
+  node.SubscribeTemps(60, 100.0f);
+  testRunUpdate(radio, channel, 1);
+
+  TEST_ASSERT_EQUAL_INT(255, channel.TempPushDelta(GH_ADDR_NODE_1));
+}
+
+void Test_Rto_SteadyRtt_ConvergesOnRtt(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  channel.NodeLatency(GH_ADDR_NODE_1, 300);
+  Radio radio;
+  testInit(radio, channel);
+  radio::Node &node = *radio.AddNode(GH_ADDR_NODE_1, radio::k_capTemps);
+  testRun(radio, channel, 2000);
+
+  // the first sample sets rttvar to half the rtt, so rto starts at 3x.
+  const unsigned long rtt = node.Stats().rtt.Max();
+  TEST_ASSERT_EQUAL(true, node.Rto() >= rtt * 2);
+
+  for (int i = 0; i < 40; i++) {
+    TestExchange exchange;
+    testSendPoll(radio, GH_ADDR_NODE_1, exchange);
+    testRunUntilDone(radio, channel, &exchange, 1, 5000);
+    TEST_ASSERT_EQUAL_INT(1, exchange.attempts);
+  }
+
+  TEST_ASSERT_EQUAL(true, node.Rto() >= rtt);
+  TEST_ASSERT_EQUAL(true, node.Rto() <= rtt + (rtt / 10));
+}
+
+void Test_Rto_FastAndSlowNodes_HeldToMinAndMax(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  channel.AddNode(GH_ADDR_NODE_2);
+  channel.NodeLatency(GH_ADDR_NODE_2, 800);
+  Radio radio;
+  radio.RtoInitial(5000);
+  radio.RtoMin(200);
+  radio.RtoMax(1000);
+  testInit(radio, channel);
+  testAddNodes(radio);
+  testRun(radio, channel, 2000);
+
+  // rtt is ~50ms and ~850ms, so srtt + 4 * rttvar is under and over.
+  TEST_ASSERT_EQUAL(true, radio.FindNode(GH_ADDR_NODE_1)->Online());
+  TEST_ASSERT_EQUAL(true, radio.FindNode(GH_ADDR_NODE_2)->Online());
+  TEST_ASSERT_EQUAL_INT(200, radio.FindNode(GH_ADDR_NODE_1)->Rto());
+  TEST_ASSERT_EQUAL_INT(1000, radio.FindNode(GH_ADDR_NODE_2)->Rto());
+}
+
+void Test_Rto_ResponseAfterRetry_NoSample(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  channel.NodeLatency(GH_ADDR_NODE_1, 600);
+  Radio radio;
+  testInit(radio, channel);
+  radio::Node &node = *radio.AddNode(GH_ADDR_NODE_1, radio::k_capTemps);
+  testRun(radio, channel, 3000);
+
+  // the hello's reply came after its retry; it could be for either, so
+  // the rtt is unknown (karn).
+  TEST_ASSERT_EQUAL(true, node.Online());
+  TEST_ASSERT_EQUAL_INT(2, node.Stats().counts[radio::k_statsHello][radio::k_statsAttempts]);
+  TEST_ASSERT_EQUAL_INT(radio.RtoInitial(), node.Rto());
+}
+
+void Test_Rto_NoResponse_TimeoutDoublesEachAttempt(void)
+{
+  SimRadioConfig config;
+  SimRadioChannel channel(config);
+  Radio radio;
+  radio.RetryMax(4);
+  radio.RtoInitial(200);
+  testInit(radio, channel);
+  radio.AddNode(GH_ADDR_NODE_1, radio::k_capTemps);
+
+  // when each attempt of the hello goes out.
+  unsigned long sent[4] = {};
+  int attempts = 0;
+  for (unsigned long i = 0; (i < 5000) && (attempts < 4); i++) {
+    const int frames = channel.FramesSent();
+    radio.Loop();
+    if (channel.FramesSent() != frames) {
+      sent[attempts++] = channel.Millis();
+    }
+    channel.Step();
+  }
+
+  TEST_ASSERT_EQUAL_INT(4, attempts);
+  TEST_ASSERT_EQUAL_INT(200, sent[1] - sent[0]);
+  TEST_ASSERT_EQUAL_INT(400, sent[2] - sent[1]);
+  TEST_ASSERT_EQUAL_INT(800, sent[3] - sent[2]);
+}
+
+void testRadio()
+{
+  RUN_TEST(Test_Send_CleanChannel_OkFirstAttempt);
+  RUN_TEST(Test_Send_NodeMissing_FailsAfterRetryMax);
+  RUN_TEST(Test_Send_ResponsesDuplicated_DoneOnce);
+  RUN_TEST(Test_MotorRunAll_FramesDuplicated_EachNodeRunsOnce);
+  RUN_TEST(Test_MotorRunAll_GroupAckLostThenUnicast_RetryGetsReplay);
+  RUN_TEST(Test_MotorRunAll_UnicastSameSeqInFlight_NotTakenForGroupAck);
+  RUN_TEST(Test_Send_NodeRepliesError_FailsWithoutRetry);
+  RUN_TEST(Test_Send_NodeMissing_CountsAttemptsAndTimeouts);
+  RUN_TEST(Test_RttHistogram_Percentile_BucketUpperBoundOrMax);
+  RUN_TEST(Test_MotorRun_SpeedSet_SpeedAndRunInOneExchange);
+  RUN_TEST(Test_KeepAlive_PolledNode_NoExtraHello);
+  RUN_TEST(Test_Send_NoiseBeforeFrames_OkFirstAttempt);
+  RUN_TEST(Test_Parse_FalseMarker_ResyncsToFrame);
+  RUN_TEST(Test_Dedupe_OutOfOrder_EachSeenOnce);
+  RUN_TEST(Test_Dedupe_OldSeqAgain_SeenButOnlyLastReplayed);
+  RUN_TEST(Test_Dedupe_TwoSenders_WindowEach);
+  RUN_TEST(Test_Dedupe_SeqWraps_NewAfterWrapOldStillSeen);
+  RUN_TEST(Test_Dedupe_HelloAfterRestart_StartsAgain);
+  RUN_TEST(Test_AddNode_ManyNodes_AllComeOnline);
+  RUN_TEST(Test_Send_FecOneBitFlippedPerFrame_OkFirstAttempt);
+  RUN_TEST(Test_Link_FarNodeLosesFrames_NearNodeFastFarNodeRobust);
+  RUN_TEST(Test_Link_OneExchangeFailsOnFast_StaysFast);
+  RUN_TEST(Test_Link_NodeGoneOnFast_FallsBackAndReconnects);
+  RUN_TEST(Test_Link_RestartWithModuleOnFast_BackToRobust);
+  RUN_TEST(Test_Link_NodesOnDifferentLinks_SwitchDoesNotHoldLoop);
+  RUN_TEST(Test_Reconnect_NodeMissing_HelloBacksOffUntilNodeBack);
+  RUN_TEST(Test_DutyCycle_KeepAliveFlood_HeldToBudget);
+  RUN_TEST(Test_Queue_SlotsFullOfPolls_SafetyRunStartsAtOnce);
+  RUN_TEST(Test_Poll_TwoNodesDifferentLatency_CycleTakesSlowest);
+  RUN_TEST(Test_Queue_TelemetryFillsInFlight_ActuationSlotsFree);
+  RUN_TEST(Test_Queue_PollPastDeadline_DroppedUnsent);
+  RUN_TEST(Test_TempResolution_SetBeforeOnline_SentWithHello);
+  RUN_TEST(Test_TempStats_TwoDevicesOneUnread_StatsInOneExchange);
+  RUN_TEST(Test_TempPush_Subscribed_TempsUpdateWithoutPolls);
+  RUN_TEST(Test_TempPush_SubscribeDelta_SmallMoveWaitsLargeMovePushed);
+  RUN_TEST(Test_Rto_SteadyRtt_ConvergesOnRtt);
+  RUN_TEST(Test_Rto_FastAndSlowNodes_HeldToMinAndMax);
+  RUN_TEST(Test_Rto_ResponseAfterRetry_NoSample);
+  RUN_TEST(Test_Rto_NoResponse_TimeoutDoublesEachAttempt);
+}
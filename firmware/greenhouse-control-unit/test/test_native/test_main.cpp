@@ -10,6 +10,7 @@ void process()
   testSystem();
   testHeating();
   testTime();
+  testRadio();
   UNITY_END();
 }
 
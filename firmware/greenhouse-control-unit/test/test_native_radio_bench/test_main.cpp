@@ -0,0 +1,212 @@
+// radio benchmark against the simulated channel, on virtual time;
+// pio test -e native -f test_native_radio_bench -v
+//
+// for each channel and retry/timeout/fec/link setting, keeps one temperature
+// request in flight to each node and reports goodput (successful
+// exchanges per second), exchange latency and retries per success.
+
+#include "SimRadioChannel.h"
+#include "../../lib/native/greenhouse/radio/NodeRadio.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <vector>
+
+#include <unity.h>
+
+using namespace native::greenhouse;
+
+#define BENCH_NODES 2
+#define BENCH_EXCHANGES 500
+#define BENCH_TIME_MAX 3600000 // 1h virtual
+#define BENCH_WARM_UP 90000    // hellos, and link steps up to fast
+
+struct BenchChannel {
+  const char *name;
+  SimRadioConfig config;
+};
+
+struct BenchSetting {
+  int retryMax;
+  unsigned long rtoMin;
+  bool fec;
+  uint8_t linkMax;
+};
+
+struct BenchExchange {
+  bool active = false;
+  unsigned long start = 0;
+};
+
+struct BenchResult {
+  int ok = 0;
+  int failed = 0;
+  int retries = 0;
+  unsigned long time = 0;
+  std::vector<unsigned long> latencies;
+};
+
+static SimRadioChannel *s_channel = nullptr;
+static BenchResult *s_result = nullptr;
+
+void benchExchangeDone(radio::SendDesc &sendDesc, bool ok)
+{
+  BenchExchange *exchange = (BenchExchange *)sendDesc.okCallbackArg;
+  exchange->active = false;
+  s_result->retries += sendDesc.attempts - 1;
+
+  if (ok) {
+    s_result->ok++;
+    s_result->latencies.push_back(s_channel->Millis() - exchange->start);
+  }
+  else {
+    s_result->failed++;
+  }
+}
+
+void benchRequest(Radio &radio, int index, BenchExchange &exchange)
+{
+  radio::Node &node = radio.Node(index);
+
+  radio::SendDesc sd;
+  sd.to = node.Address();
+  sd.cmd = GH_CMD_TEMP_ALL_REQ;
+  sd.expectCmd = GH_CMD_TEMP_ALL_RSP;
+  sd.okCallbackArg = &exchange;
+  sd.doneCallback = &benchExchangeDone;
+
+  exchange.active = node.Send(sd);
+  exchange.start = s_channel->Millis();
+}
+
+BenchResult bench(const BenchChannel &benchChannel, const BenchSetting &setting)
+{
+  SimRadioChannel channel(benchChannel.config);
+  channel.AddNode(GH_ADDR_NODE_1);
+  channel.AddNode(GH_ADDR_NODE_2);
+
+  Radio radio;
+  radio.RetryMax(setting.retryMax);
+  radio.RtoMin(setting.rtoMin);
+  radio.Init(channel);
+  radio.AddNode(GH_ADDR_NODE_1, radio::k_capMotor | radio::k_capTemps);
+  radio.AddNode(GH_ADDR_NODE_2, radio::k_capMotor);
+  for (int i = 0; i < BENCH_NODES; i++) {
+    radio.Node(i).Fec(setting.fec);
+    radio.Node(i).LinkMax(setting.linkMax);
+  }
+
+  BenchResult result;
+  s_channel = &channel;
+  s_result = &result;
+
+  // let the hellos and link steps finish first, so they don't count.
+  for (int i = 0; i < BENCH_WARM_UP; i++) {
+    radio.Loop();
+    if ((i % 1000) == 0) {
+      radio.Update();
+    }
+    channel.Step();
+  }
+  result = BenchResult();
+
+  const unsigned long start = channel.Millis();
+  BenchExchange exchanges[BENCH_NODES];
+  int started = 0;
+
+  while ((result.ok + result.failed) < BENCH_EXCHANGES) {
+    for (int i = 0; i < BENCH_NODES; i++) {
+      if (!exchanges[i].active && (started < BENCH_EXCHANGES)) {
+        benchRequest(radio, i, exchanges[i]);
+        started++;
+      }
+    }
+
+    radio.Loop();
+    if ((channel.Millis() % 1000) == 0) {
+      radio.Update();
+    }
+    channel.Step();
+
+    if ((channel.Millis() - start) > BENCH_TIME_MAX) {
+      break;
+    }
+  }
+
+  result.time = channel.Millis() - start;
+  s_channel = nullptr;
+  s_result = nullptr;
+  return result;
+}
+
+unsigned long percentile(std::vector<unsigned long> &values, int p)
+{
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  const size_t i = std::min(values.size() - 1, (values.size() * p) / 100);
+  return values[i];
+}
+
+void Bench_Radio_ChannelsAndSettings(void)
+{
+  BenchChannel channels[4];
+  channels[0].name = "clean";
+  channels[0].config.latency = 10;
+  channels[0].config.jitter = 20;
+  channels[1].name = "loss10";
+  channels[1].config = channels[0].config;
+  channels[1].config.loss = 0.1f;
+  channels[2].name = "noisy";
+  channels[2].config = channels[0].config;
+  channels[2].config.loss = 0.2f;
+  channels[2].config.duplicate = 0.05f;
+  channels[2].config.corrupt = 0.05f;
+  channels[2].config.jitter = 200;
+  channels[3].name = "ber1e-3";
+  channels[3].config = channels[0].config;
+  channels[3].config.bitError = 0.001f;
+
+  const BenchSetting settings[] = {
+    {1, 150, false, GH_LINK_ROBUST}, {3, 150, false, GH_LINK_ROBUST}, {5, 150, false, GH_LINK_ROBUST},
+    {3, 50, false, GH_LINK_ROBUST},  {3, 500, false, GH_LINK_ROBUST}, {5, 500, false, GH_LINK_ROBUST},
+    {3, 150, true, GH_LINK_ROBUST},  {5, 150, true, GH_LINK_ROBUST},  {3, 150, false, GH_LINK_FAST},
+    {3, 150, true, GH_LINK_FAST}};
+
+  printf("\n%-8s %5s %6s %4s %4s %8s %8s %8s %8s %8s\n",
+    "channel", "retry", "rtoMin", "fec", "link", "ok", "req/s", "p50 ms", "p99 ms", "retry/ok");
+
+  for (const BenchChannel &channel : channels) {
+    for (const BenchSetting &setting : settings) {
+      BenchResult result = bench(channel, setting);
+
+      const float goodput = (result.time != 0) ? (result.ok * 1000.0f / result.time) : 0;
+      const float retries = (result.ok != 0) ? ((float)result.retries / result.ok) : 0;
+      printf("%-8s %5d %6lu %4s %4d %4d/%-3d %8.2f %8lu %8lu %8.2f\n",
+        channel.name,
+        setting.retryMax,
+        setting.rtoMin,
+        setting.fec ? "on" : "off",
+        setting.linkMax,
+        result.ok,
+        result.ok + result.failed,
+        goodput,
+        percentile(result.latencies, 50),
+        percentile(result.latencies, 99),
+        retries);
+
+      if ((channel.config.loss == 0) && (channel.config.bitError == 0)) {
+        TEST_ASSERT_EQUAL_INT(0, result.failed);
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(Bench_Radio_ChannelsAndSettings);
+  UNITY_END();
+  return 0;
+}
@@ -21,6 +21,10 @@ void setup() {
   radio_init();
 #endif  // RADIO_EN
 
+#if TEMP_EN
+  temp_init();
+#endif  // TEMP_EN
+
 #if LED_DEBUG
   leds_startPost();
 #endif  // LED_DEBUG
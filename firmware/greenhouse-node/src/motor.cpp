@@ -13,7 +13,12 @@
 
 unsigned long motorStop = 0;
 
+// run requested while the motor was busy; started when it stops.
+byte queuedDir = 0;
+byte queuedSecs = 0;
+
 void testMotor();
+void start(byte dir, byte secs);
 
 void motor_init() {
   pinMode(PIN_MOTOR_PWM, OUTPUT);
@@ -24,37 +29,57 @@ void motor_init() {
 }
 
 void motor_loop() {
-  if (!motor_on()) {
-    clear(SR_PIN_MOTOR_A);
-    clear(SR_PIN_MOTOR_B);
-    shift();
+  if (motor_on()) {
+    return;
   }
+
+  if (queuedDir != 0) {
+    start(queuedDir, queuedSecs);
+    queuedDir = 0;
+    return;
+  }
+
+  clear(SR_PIN_MOTOR_A);
+  clear(SR_PIN_MOTOR_B);
+  shift();
 }
 
 void motor_speed(byte pwm) { analogWrite(PIN_MOTOR_PWM, pwm); }
 
+bool motor_valid(byte dir) { return (dir == GH_MOTOR_FORWARD) || (dir == GH_MOTOR_REVERSE); }
+
 bool motor_run(byte dir, byte secs) {
-  motorStop = millis() + (secs * 1000);
-  switch (dir) {
-    case GH_MOTOR_FORWARD: {
-      set(SR_PIN_MOTOR_B);
-      clear(SR_PIN_MOTOR_A);
-    } break;
-
-    case GH_MOTOR_REVERSE: {
-      set(SR_PIN_MOTOR_A);
-      clear(SR_PIN_MOTOR_B);
-    } break;
-
-    default:
-      return false;
+  if (!motor_valid(dir)) {
+    return false;
   }
-  shift();
+
+  // a newer run replaces any run that's already queued.
+  if (motor_on()) {
+    queuedDir = dir;
+    queuedSecs = secs;
+    return true;
+  }
+
+  start(dir, secs);
   return true;
 }
 
+void start(byte dir, byte secs) {
+  motorStop = millis() + (secs * 1000UL);
+  if (dir == GH_MOTOR_FORWARD) {
+    set(SR_PIN_MOTOR_B);
+    clear(SR_PIN_MOTOR_A);
+  } else {
+    set(SR_PIN_MOTOR_A);
+    clear(SR_PIN_MOTOR_B);
+  }
+  shift();
+}
+
 bool motor_on() { return millis() < motorStop; }
 
+bool motor_queued() { return queuedDir != 0; }
+
 #if MOTOR_TEST
 
 #define TEST_DELAY 500
@@ -5,5 +5,7 @@
 void motor_init();
 void motor_loop();
 void motor_speed(byte pwm);
+bool motor_valid(byte dir);
 bool motor_run(byte dir, byte secs);
 bool motor_on();
+bool motor_queued();
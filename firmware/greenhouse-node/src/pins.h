@@ -3,6 +3,7 @@
 #include "attiny.h"
 
 #define PIN_TX_EN PIN_PA0
+#define PIN_HC12_SET PIN_PA0  // same pin as PIN_TX_EN, which is ask only
 #define PIN_TX PIN_PA1
 #define PIN_RX PIN_PA2
 #define PIN_ONE_WIRE PIN_PA3
@@ -22,10 +22,19 @@
 
 #define TX_BIT_RATE 2000
 #define TX_WAIT_DELAY 20
-#define ERROR_DELAY 500
+#define ERROR_DELAY 500  // error led held on, without blocking the loop
+
+// set pin wired to the module; without it, the link stays robust.
+#ifndef HC12_SET_EN
+#define HC12_SET_EN 0
+#endif
 
 #if RADIO_HC12
-#define BAUD 9600
+#define HC12_SET_DELAY 80   // to enter or leave at command mode
+#define HC12_AT_DELAY 100   // for an at command to be answered
+#define HC12_TX_MARGIN 30   // module latency, before the last byte is on air
+#define HC12_TX_TIME(bytes, link) (((bytes) * 10000UL) / GH_LINK_BAUD(link))
+#define HC12_RX_GAP 20      // ms without a byte, and a frame's given up on
 #endif // RADIO_HC12
 
 #if RADIO_ASK
@@ -36,13 +45,70 @@ RH_ASK driver(TX_BIT_RATE, PIN_RX, PIN_TX, PIN_TX_EN);
 static SoftwareSerial s_hc12(PIN_TX, PIN_RX);
 #endif // RADIO_HC12
 
-uint8_t rxBuf[GH_LENGTH];
-uint8_t txBuf[GH_LENGTH];
-byte sequence = 0;
+uint8_t rxBuf[GH_LENGTH_MAX];
+uint8_t txBuf[GH_LENGTH_MAX];
+
+#if RADIO_HC12
+gh_parser rxParser;
+
+// reply the way the request came (fec or not); the sender picks per link.
+bool txFec = false;
+
+byte link = GH_LINK_ROBUST;
+byte linkNext = GH_LINK_ROBUST;  // changed once the ack has gone
+unsigned long lastRx = 0;
+unsigned long lastRxByte = 0;
+#endif // RADIO_HC12
+
+bool errorLit = false;
+unsigned long errorAt = 0;
+
+// requests already handled, per sender.
+gh_dedupe rxDedupe;
+
+// a group reply waits in txBuf for this node's slot, while the loop
+// carries on.
+bool replyPending = false;
+unsigned long replyAt = 0;
 
+// building a reply again for a retry; commands that can't safely run
+// twice (e.g. motor run) only check their request, so the reply matches.
+bool replaying = false;
+
+#if MOTOR_EN
+#define RADIO_GROUP GH_ADDR_WINDOWS
+#endif // MOTOR_EN
+
+#if TEMP_EN
+unsigned long pushInterval = 0;
+unsigned long nextPush = 0;
+byte pushTo = GH_ADDR_MAIN;
+byte pushDelta = 0;
+byte pushSequence = 0;
+bool pushFec = false;
+#endif // TEMP_EN
+
+bool rxFrame(uint8_t* len);
+void setLink(byte next);
 bool handleRx();
+bool handleBatch();
+bool handleCmd(const byte* req, byte* rsp);
+bool isGroupRx();
+byte rxKey();
+gh_dedupeWindow* rxWindow();
+bool isHelloRx();
+bool isDupeRx();
+bool isReplay();
+void handle();
+void reply();
+void replyNow();
+void send();
+void pushTemps();
+void showError();
 
 void radio_init() {
+  gh_dedupeInit(&rxDedupe);
+
 #if RADIO_ASK
   if (!driver.init()) {
     leds(0, 0, 1);
@@ -53,7 +119,21 @@ void radio_init() {
 #endif // RADIO_ASK
 
 #if RADIO_HC12
-  s_hc12.begin(BAUD);
+  gh_parseInit(&rxParser, rxBuf);
+
+#if HC12_SET_EN
+  pinMode(PIN_HC12_SET, OUTPUT);
+  digitalWrite(PIN_HC12_SET, HIGH);
+
+  // the module keeps its settings over a restart, and only takes at
+  // commands at the baud it's on, which isn't known; try each.
+  for (byte from = GH_LINK_ROBUST; from <= GH_LINK_MAX; from++) {
+    link = from;
+    setLink(GH_LINK_ROBUST);
+  }
+#else
+  s_hc12.begin(GH_LINK_BAUD(GH_LINK_ROBUST));
+#endif // HC12_SET_EN
 #endif // RADIO_HC12
 }
 
@@ -73,75 +153,344 @@ void testRadio() {
 
 #endif  // TX_TEST
 
+// a frame is coming in. a one wire transfer turns interrupts off for each
+// bit slot, long enough for software serial to lose bits at the faster
+// links, so the temperature reads wait for it.
+bool radio_busy() {
+#if RADIO_HC12
+  return s_hc12.available() || (rxParser.sync && ((millis() - lastRxByte) < HC12_RX_GAP));
+#else
+  return false;
+#endif // RADIO_HC12
+}
+
 void radio_loop() {
 #if TX_TEST
   testRadio();
 #else
 
-  leds(0, 1, 0);
+  if (!errorLit || ((millis() - errorAt) >= ERROR_DELAY)) {
+    errorLit = false;
+    leds(0, 1, 0);
+  }
 
-  uint8_t rxBufLen = GH_LENGTH;
+  if (replyPending && (millis() >= replyAt)) {
+    replyPending = false;
+    replyNow();
+  }
+
+#if TEMP_EN
+  pushTemps();
+#endif // TEMP_EN
+
+#if RADIO_HC12 && HC12_SET_EN
+  // the control unit can't reach us on this link any more.
+  if ((link != GH_LINK_ROBUST) && ((millis() - lastRx) > GH_LINK_FALLBACK)) {
+    setLink(GH_LINK_ROBUST);
+  }
+#endif // RADIO_HC12 && HC12_SET_EN
+
+  uint8_t rxBufLen = GH_LENGTH_MAX;
 
 #if RADIO_ASK
   if (driver.recv(rxBuf, &rxBufLen)) {
 #endif // RADIO_ASK
 
 #if RADIO_HC12
-  if (s_hc12.available()) {
-    rxBufLen = s_hc12.readBytes(rxBuf, GH_LENGTH);
-    if (rxBufLen != GH_LENGTH) {
-      leds(0, 1, 1);
-      delay(ERROR_DELAY);
+  if (rxFrame(&rxBufLen)) {
+#endif // RADIO_HC12
+
+#if RADIO_ASK
+    // drop incomplete or corrupt frames early; the sender will retry.
+    // rxFrame has already checked both for hc-12.
+    if ((rxBufLen != GH_FRAME_LENGTH(rxBuf)) || !gh_crcCheck(rxBuf)) {
+      showError();
       return;
     }
+#endif // RADIO_ASK
+
+    if ((GH_TO(rxBuf) == RADIO_ADDR) || isGroupRx()) {
+#if RADIO_HC12
+      lastRx = millis();
 #endif // RADIO_HC12
 
-    if (GH_TO(rxBuf) == RADIO_ADDR) {
-      GH_TO(txBuf) = GH_FROM(rxBuf);
-      GH_FROM(txBuf) = RADIO_ADDR;
-      GH_SEQ(txBuf) = GH_SEQ(rxBuf);
+      // txBuf is still waiting for its slot; not seen yet, so the
+      // sender's retry is handled.
+      if (replyPending) {
+        return;
+      }
 
-      // by default, send commnad back to say what we're replying to.
-      GH_CMD(txBuf) = GH_CMD_ACK;
-      GH_DATA_1(txBuf) = GH_CMD(rxBuf);
+#if RADIO_HC12
+      txFec = rxParser.fec;
+#endif // RADIO_HC12
 
-      if (!handleRx()) {
-        leds(0, 1, 1);
-        delay(ERROR_DELAY);
+      if (isDupeRx()) {
+        // don't run it twice; reply again if it's a retry of the last
+        // request from this sender, and drop anything older.
+        if (isReplay()) {
+          replaying = true;
+          handle();
+          replaying = false;
+          reply();
+        }
+        return;
       }
 
-      delay(TX_WAIT_DELAY);
-      leds(1, 0, 0);
+      handle();
+      gh_dedupeHandled(rxWindow(), GH_CMD(rxBuf), GH_SEQ(rxBuf));
+      reply();
+    }
+  }
+
+#endif  // TX_TEST
+}
+
+#if RADIO_HC12
+
+// a byte at a time as it arrives, so a stray or lost byte only costs the
+// frame it's in.
+bool rxFrame(uint8_t* len) {
+  while (s_hc12.available()) {
+    lastRxByte = millis();
+    const uint8_t result = gh_parse(&rxParser, s_hc12.read());
+    if (result == GH_PARSE_FRAME) {
+      *len = rxParser.length;
+      return true;
+    }
+    if (result == GH_PARSE_DROPPED) {
+      leds(0, 1, 1);
+    }
+  }
+  return false;
+}
+
+#if HC12_SET_EN
+
+// at command mode is through the set pin; the control unit switches its
+// own module to the same link once it has the ack. with set pulled low
+// while powered, the module takes commands at its current baud (9600 is
+// only for set held low at power up).
+void setLink(byte next) {
+  digitalWrite(PIN_HC12_SET, LOW);
+  delay(HC12_SET_DELAY);
+  s_hc12.begin(GH_LINK_BAUD(link));
+  s_hc12.print(F("AT+FU3"));
+  delay(HC12_AT_DELAY);
+  s_hc12.print(F("AT+B"));
+  s_hc12.print(GH_LINK_BAUD(next));
+  delay(HC12_AT_DELAY);
+  digitalWrite(PIN_HC12_SET, HIGH);
+  delay(HC12_SET_DELAY);
+
+  // drop the module's replies.
+  while (s_hc12.available()) {
+    s_hc12.read();
+  }
+  s_hc12.begin(GH_LINK_BAUD(next));
+
+  link = next;
+  linkNext = next;
+  lastRx = millis();
+}
+
+#endif // HC12_SET_EN
+#endif // RADIO_HC12
+
+void reply() {
+  // every group member replies, so take turns to avoid talking over
+  // each other.
+  if (isGroupRx()) {
+    replyAt = millis() + (GH_GROUP_ACK_SLOT * GH_NODE_INDEX(RADIO_ADDR));
+    replyPending = true;
+    return;
+  }
+  replyNow();
+}
+
+void replyNow() {
+  send();
+
+#if RADIO_HC12 && HC12_SET_EN
+  if (linkNext != link) {
+    // writes are bit-banged, so the bytes have left by now, but the
+    // module is still putting them on air; set low would cut the ack off.
+    const unsigned int frame = GH_FRAME_LENGTH(txBuf);
+    const unsigned int bytes = GH_SOF_LENGTH + (txFec ? GH_FEC_LENGTH(frame) : frame);
+    delay(HC12_TX_TIME(bytes, link) + HC12_TX_MARGIN);
+    setLink(linkNext);
+  }
+#endif // RADIO_HC12 && HC12_SET_EN
+}
+
+void send() {
+  gh_crcWrite(txBuf);
+
+  delay(TX_WAIT_DELAY);
+  leds(1, 0, 0);
 
 #if RADIO_ASK
-      driver.send(txBuf, GH_LENGTH);
-      driver.waitPacketSent();
+  driver.send(txBuf, GH_FRAME_LENGTH(txBuf));
+  driver.waitPacketSent();
 #endif // RADIO_ASK
 
 #if RADIO_HC12
-      s_hc12.write(txBuf, GH_LENGTH);
+  if (txFec) {
+    s_hc12.write(GH_SOF_FEC);
+    for (byte i = 0; i < GH_FRAME_LENGTH(txBuf); i++) {
+      byte code[2];
+      gh_fecEncodeByte(txBuf[i], code);
+      s_hc12.write(code, 2);
+    }
+  } else {
+    s_hc12.write(GH_SOF);
+    s_hc12.write(txBuf, GH_FRAME_LENGTH(txBuf));
+  }
 #endif
+}
 
-      sequence = GH_SEQ(rxBuf);
-    }
+#if TEMP_EN
+
+void pushTemps() {
+  // txBuf is in use.
+  if ((pushInterval == 0) || replyPending) {
+    return;
   }
 
-#endif  // TX_TEST
+  // push on the interval, or sooner if a reading has moved enough.
+  if ((millis() < nextPush) && !temp_moved(pushDelta)) {
+    return;
+  }
+
+  GH_TO(txBuf) = pushTo;
+  GH_FROM(txBuf) = RADIO_ADDR;
+  GH_SEQ(txBuf) = pushSequence++;
+  GH_CMD(txBuf) = GH_CMD_TEMP_PUSH;
+  GH_DATA_1(txBuf) = temp_all(&GH_TEMP_ALL_DATA(txBuf, 0, 0));
+  GH_LEN(txBuf) = GH_TEMP_ALL_LENGTH(GH_DATA_1(txBuf));
+#if RADIO_HC12
+  txFec = pushFec;
+#endif // RADIO_HC12
+  send();
+
+  temp_mark();
+  nextPush = millis() + pushInterval;
 }
 
-bool isDupeRx() {
-  // prevent duplicate messages, only in some cases.
-  if (GH_SEQ(rxBuf) == sequence) {
-    GH_CMD(txBuf) = GH_CMD_ERROR;
-    GH_DATA_1(txBuf) = GH_ERROR_BAD_SEQ;
-    return true;
-  }
+#endif  // TEMP_EN
+
+bool isGroupRx() {
+#ifdef RADIO_GROUP
+  return GH_TO(rxBuf) == RADIO_GROUP;
+#else
   return false;
+#endif
+}
+
+// group frames have their own sequence, so they're tracked separately.
+byte rxKey() { return isGroupRx() ? GH_TO(rxBuf) : GH_FROM(rxBuf); }
+
+gh_dedupeWindow* rxWindow() { return gh_dedupeFind(&rxDedupe, rxKey(), GH_SEQ(rxBuf)); }
+
+bool isDupeRx() { return gh_dedupeSeen(rxWindow(), GH_SEQ(rxBuf), isHelloRx()); }
+
+bool isHelloRx() {
+  return (GH_CMD(rxBuf) == GH_CMD_HELLO) ||
+    ((GH_CMD(rxBuf) == GH_CMD_BATCH) && (GH_DATA_1(rxBuf) != 0) &&
+     (GH_BATCH_ENTRY(rxBuf, 0, 0) == GH_CMD_HELLO));
+}
+
+bool isReplay() { return gh_dedupeIsLast(rxWindow(), GH_CMD(rxBuf), GH_SEQ(rxBuf)); }
+
+// reply built in txBuf.
+void handle() {
+  GH_TO(txBuf) = GH_FROM(rxBuf);
+  GH_FROM(txBuf) = RADIO_ADDR;
+  GH_SEQ(txBuf) = GH_SEQ(rxBuf);
+  GH_LEN(txBuf) = GH_PAYLOAD_DEFAULT;
+
+  // by default, send commnad back to say what we're replying to.
+  GH_CMD(txBuf) = GH_CMD_ACK;
+  GH_DATA_1(txBuf) = GH_CMD(rxBuf);
+
+  if (!handleRx()) {
+    showError();
+  }
+}
+
+void showError() {
+  errorLit = true;
+  errorAt = millis();
+  leds(0, 1, 1);
 }
 
 bool handleRx() {
   switch (GH_CMD(rxBuf)) {
 
+#if TEMP_EN
+
+    case GH_CMD_TEMP_ALL_REQ: {
+      GH_CMD(txBuf) = GH_CMD_TEMP_ALL_RSP;
+      GH_DATA_1(txBuf) = temp_all(&GH_TEMP_ALL_DATA(txBuf, 0, 0));
+      GH_LEN(txBuf) = GH_TEMP_ALL_LENGTH(GH_DATA_1(txBuf));
+      return true;
+    }
+
+    case GH_CMD_TEMP_STATS_REQ: {
+      GH_CMD(txBuf) = GH_CMD_TEMP_STATS_RSP;
+      GH_DATA_1(txBuf) = temp_stats(&GH_TEMP_STATS_DATA(txBuf, 0, 0));
+      GH_LEN(txBuf) = GH_TEMP_STATS_LENGTH(GH_DATA_1(txBuf));
+      return true;
+    }
+
+#endif  // TEMP_EN
+
+    case GH_CMD_BATCH: {
+      return handleBatch();
+    }
+
+    default: {
+      // simple commands; request and response are [cmd, d1, d2].
+      byte req[GH_BATCH_ENTRY_LENGTH] = { GH_CMD(rxBuf), GH_DATA_1(rxBuf), GH_DATA_2(rxBuf) };
+      byte rsp[GH_BATCH_ENTRY_LENGTH] = { GH_CMD(txBuf), GH_DATA_1(txBuf), 0 };
+      const bool ok = handleCmd(req, rsp);
+      GH_CMD(txBuf) = rsp[0];
+      GH_DATA_1(txBuf) = rsp[1];
+      GH_DATA_2(txBuf) = rsp[2];
+      return ok;
+    }
+  }
+}
+
+bool handleBatch() {
+  const byte count = GH_DATA_1(rxBuf);
+  if ((count == 0) || (count > GH_BATCH_MAX) || (GH_LEN(rxBuf) != GH_BATCH_LENGTH(count))) {
+    GH_CMD(txBuf) = GH_CMD_ERROR;
+    GH_DATA_1(txBuf) = GH_ERROR_BAD_CMD;
+    GH_DATA_2(txBuf) = GH_CMD_BATCH;
+    return false;
+  }
+
+  // run each entry in turn, even if an earlier one failed; the reply says
+  // how each one went.
+  bool ok = true;
+  GH_CMD(txBuf) = GH_CMD_BATCH_RSP;
+  GH_DATA_1(txBuf) = count;
+  GH_LEN(txBuf) = GH_BATCH_LENGTH(count);
+  for (byte i = 0; i < count; i++) {
+    byte* rsp = &GH_BATCH_ENTRY(txBuf, i, 0);
+    rsp[0] = GH_CMD_ACK;
+    rsp[1] = GH_BATCH_ENTRY(rxBuf, i, 0);
+    rsp[2] = 0;
+    if (!handleCmd(&GH_BATCH_ENTRY(rxBuf, i, 0), rsp)) {
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+bool handleCmd(const byte* req, byte* rsp) {
+  switch (req[0]) {
+
     case GH_CMD_HELLO: {
       // nothing to do; ack is the default.
     } break;
@@ -149,14 +498,41 @@ bool handleRx() {
 #if TEMP_EN
 
     case GH_CMD_TEMP_DEVS_REQ: {
-      GH_CMD(txBuf) = GH_CMD_TEMP_DEVS_RSP;
-      GH_DATA_1(txBuf) = temp_devs();
+      rsp[0] = GH_CMD_TEMP_DEVS_RSP;
+      rsp[1] = temp_devs();
+    } break;
+
+    case GH_CMD_TEMP_RESCAN: {
+      if (!replaying) {
+        temp_rescan();
+      }
+    } break;
+
+    case GH_CMD_TEMP_RES: {
+      if (!temp_resolution(req[1])) {
+        rsp[0] = GH_CMD_ERROR;
+        rsp[1] = GH_ERROR_BAD_TEMP_RES;
+        return false;
+      }
     } break;
 
     case GH_CMD_TEMP_DATA_REQ: {
-      GH_CMD(txBuf) = GH_CMD_TEMP_DATA_RSP;
-      GH_DATA_1(txBuf) = temp_data(GH_DATA_1(rxBuf), 0);
-      GH_DATA_2(txBuf) = temp_data(GH_DATA_1(rxBuf), 1);
+      rsp[0] = GH_CMD_TEMP_DATA_RSP;
+      rsp[1] = temp_data(req[1], 0);
+      rsp[2] = temp_data(req[1], 1);
+    } break;
+
+    case GH_CMD_TEMP_SUB: {
+      if (replaying) {
+        break;
+      }
+      pushTo = GH_FROM(rxBuf);
+      pushInterval = req[1] * 1000UL;
+      pushDelta = req[2];
+      nextPush = millis() + pushInterval;
+#if RADIO_HC12
+      pushFec = rxParser.fec;
+#endif // RADIO_HC12
     } break;
 
 #endif  // TEMP_EN
@@ -164,30 +540,41 @@ bool handleRx() {
 #if MOTOR_EN
 
     case GH_CMD_MOTOR_SPEED: {
-      motor_speed(GH_DATA_1(rxBuf));
+      motor_speed(req[1]);
     } break;
 
     case GH_CMD_MOTOR_RUN: {
-      if (isDupeRx()) {
-        return false;
-      }
-      if (!motor_run(GH_DATA_1(rxBuf), GH_DATA_2(rxBuf))) {
-        GH_CMD(txBuf) = GH_CMD_ERROR;
-        GH_DATA_1(txBuf) = GH_ERROR_BAD_MOTOR_CMD;
+      if (replaying ? !motor_valid(req[1]) : !motor_run(req[1], req[2])) {
+        rsp[0] = GH_CMD_ERROR;
+        rsp[1] = GH_ERROR_BAD_MOTOR_CMD;
       }
     } break;
 
     case GH_CMD_MOTOR_STATE_REQ: {
-      GH_CMD(txBuf) = GH_CMD_MOTOR_STATE_RSP;
-      GH_DATA_1(txBuf) = (byte)motor_on();
+      rsp[0] = GH_CMD_MOTOR_STATE_RSP;
+      rsp[1] = (byte)(motor_on() || motor_queued());
     } break;
 
 #endif  // MOTOR_EN
 
+#if RADIO_HC12
+
+    case GH_CMD_LINK: {
+      // without the set pin, the module can't be told to change.
+      if ((req[1] > GH_LINK_MAX) || (!HC12_SET_EN && (req[1] != GH_LINK_ROBUST))) {
+        rsp[0] = GH_CMD_ERROR;
+        rsp[1] = GH_ERROR_BAD_LINK;
+        return false;
+      }
+      linkNext = req[1];
+    } break;
+
+#endif  // RADIO_HC12
+
     default: {
-      GH_CMD(txBuf) = GH_CMD_ERROR;
-      GH_DATA_1(txBuf) = GH_ERROR_BAD_CMD;
-      GH_DATA_2(txBuf) = GH_CMD(rxBuf);
+      rsp[0] = GH_CMD_ERROR;
+      rsp[1] = GH_ERROR_BAD_CMD;
+      rsp[2] = req[0];
       return false;
     };
   }
@@ -6,3 +6,4 @@
 
 void radio_init();
 void radio_loop();
+bool radio_busy();
@@ -3,80 +3,394 @@
 #include "temp.h"
 
 #include <OneWire.h>
+#include <gh_protocol.h>
+
+#if TEMP_EEPROM
+#include <EEPROM.h>
+#endif // TEMP_EEPROM
 
 #include "pins.h"
+#include "radio.h"
 
-#define OW_MAX_DEVS 4
+#define OW_MAX_DEVS GH_TEMP_DEVS_MAX
 #define OW_ADDR_LEN 8
 #define OW_DELAY 750  // or 1000?
 #define OW_DS18B20_CONVERT 0x44
 #define OW_READ_SCRATCH 0xBE
+#define OW_WRITE_SCRATCH 0x4E
 #define OW_ALL_DEVS 0xCC  // aka skip/ignore
 #define OW_DATA_LEN 2
-#define TEMP_UNKNOWN 255
+#define OW_SCRATCH_LEN 9  // last byte is the crc
+#define OW_SCRATCH_CONFIG 4
+#define OW_RES_MIN GH_TEMP_RES_MIN
+#define OW_RES_MAX GH_TEMP_RES_MAX  // power on default
+#define OW_ALARM_HIGH 0x4B  // power on defaults; alarms aren't used
+#define OW_ALARM_LOW 0x46
+#define OW_CONFIG(bits) ((((bits) - OW_RES_MIN) << 5) | 0x1F)
+
+// conversion time halves with each bit less; rounded up (94, 188, 375 and
+// 750ms), as a read that's early gets the last conversion.
+#define OW_DELAY_SHIFT(bits) (OW_RES_MAX - (bits))
+#define OW_DELAY_BITS(bits) \
+  (((unsigned long)OW_DELAY + (1 << OW_DELAY_SHIFT(bits)) - 1) >> OW_DELAY_SHIFT(bits))
+
+#define TEMP_UNKNOWN GH_TEMP_UNKNOWN
 #define READ_FREQ 10000  // 10s
+#define HIST_LEN 6       // 1m of reads
+#define AGE_MAX 255      // secs
+
+// conversion runs on all devices at once, while the loop carries on.
+#define STATE_IDLE 0
+#define STATE_CONVERT 1
+
+// device count, then the addresses.
+#define EEPROM_DEVS 0
+#define EEPROM_ADDRS 1
 
 static OneWire ow(PIN_ONE_WIRE);
 static byte addrs[OW_MAX_DEVS][OW_ADDR_LEN];
 static byte data[OW_MAX_DEVS][OW_DATA_LEN];
 static byte devs;
 static unsigned long nextRead = 0;
+static unsigned long convertStart;
+static byte state = STATE_IDLE;
+
+// the devices rarely change, so the bus is only searched again when a
+// read fails, or the control unit asks.
+static bool rescan = true;
+
+// wanted, and what the devices have been set to.
+static byte resolution = OW_RES_MAX;
+static byte configured = OW_RES_MAX;
+
+// a device has lost its config (a brown out); set it again.
+static bool reconfigure = false;
+
+static int16_t marked[OW_MAX_DEVS];
+
+// the last good reads of each device, so the control unit can poll less
+// often and still see what happened in between.
+static int16_t hist[OW_MAX_DEVS][HIST_LEN];
+static byte histNext[OW_MAX_DEVS];
+static byte histCount[OW_MAX_DEVS];
+
+// secs since each device's last good read, counted up by one clock so it
+// costs a byte per device.
+static byte histAge[OW_MAX_DEVS];
+static unsigned long ageTick = 0;
 
 void scan();
+void load();
+void save();
+void configure();
+bool convert();
 void read(int dev);
+void unknown(int dev);
+void histAdd(int dev);
+void histTick();
+void putRaw(byte* out, int16_t value);
 
 void temp_loop() {
-  if (millis() >= nextRead) {
-    scan();
-    for (int i = 0; i < devs; i++) {
-      read(i);
-    }
-    nextRead = millis() + READ_FREQ;
+  histTick();
+
+#if RADIO_EN
+  // a conversion that's done keeps its reading until it's read.
+  if (radio_busy()) {
+    return;
+  }
+#endif // RADIO_EN
+
+  switch (state) {
+    case STATE_IDLE: {
+      if (millis() < nextRead) {
+        return;
+      }
+
+      if (rescan) {
+        scan();
+      }
+      if (reconfigure || (resolution != configured)) {
+        configure();
+      }
+      if (!convert()) {
+        for (int i = 0; i < devs; i++) {
+          unknown(i);
+        }
+        nextRead = millis() + READ_FREQ;
+        return;
+      }
+      convertStart = millis();
+      state = STATE_CONVERT;
+    } break;
+
+    case STATE_CONVERT: {
+      // timed rather than polled, as a parasite powered device can't
+      // answer read slots while it's converting.
+      if ((millis() - convertStart) < OW_DELAY_BITS(configured)) {
+        return;
+      }
+
+      for (int i = 0; i < devs; i++) {
+        read(i);
+      }
+      nextRead = millis() + READ_FREQ;
+      state = STATE_IDLE;
+    } break;
   }
 }
 
+void temp_init() {
+  // not read yet.
+  memset(data, TEMP_UNKNOWN, sizeof(data));
+
+#if TEMP_EEPROM
+  load();
+#endif // TEMP_EEPROM
+}
+
+void temp_rescan() {
+  rescan = true;
+  nextRead = millis();
+}
+
+bool temp_resolution(byte bits) {
+  if ((bits < OW_RES_MIN) || (bits > OW_RES_MAX)) {
+    return false;
+  }
+
+  // not now, as the bus may be busy with a conversion.
+  resolution = bits;
+  return true;
+}
+
 byte temp_devs() { return devs; }
 
 byte temp_data(byte dev, byte part) { return data[dev][part]; }
 
+byte temp_all(byte* out) {
+  for (byte dev = 0; dev < devs; dev++) {
+    for (byte part = 0; part < OW_DATA_LEN; part++) {
+      *out++ = data[dev][part];
+    }
+  }
+  return devs;
+}
+
+int16_t raw(byte dev) { return (int16_t)((data[dev][1] << 8) | data[dev][0]); }
+
+// min, max, mean and age for each device; see GH_TEMP_STATS_DATA.
+byte temp_stats(byte* out) {
+  for (byte dev = 0; dev < devs; dev++) {
+    const byte count = histCount[dev];
+    if (count == 0) {
+      memset(out, TEMP_UNKNOWN, GH_TEMP_STATS_ENTRY_LENGTH);
+      out += GH_TEMP_STATS_ENTRY_LENGTH;
+      continue;
+    }
+
+    int16_t lo = hist[dev][0];
+    int16_t hi = lo;
+    long sum = 0;
+    for (byte i = 0; i < count; i++) {
+      const int16_t value = hist[dev][i];
+      if (value < lo) {
+        lo = value;
+      }
+      if (value > hi) {
+        hi = value;
+      }
+      sum += value;
+    }
+    putRaw(out + GH_TEMP_STATS_MIN, lo);
+    putRaw(out + GH_TEMP_STATS_MAX, hi);
+    putRaw(out + GH_TEMP_STATS_MEAN, (int16_t)(sum / count));
+
+    out[GH_TEMP_STATS_AGE] = histAge[dev];
+    out += GH_TEMP_STATS_ENTRY_LENGTH;
+  }
+  return devs;
+}
+
+// as the ow data; low byte first.
+void putRaw(byte* out, int16_t value) {
+  out[0] = (byte)value;
+  out[1] = (byte)(value >> 8);
+}
+
+// true if any reading has changed by more than delta (raw units)
+// since the last call to temp_mark().
+bool temp_moved(byte delta) {
+  for (byte dev = 0; dev < devs; dev++) {
+    if (abs(raw(dev) - marked[dev]) > delta) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void temp_mark() {
+  for (byte dev = 0; dev < devs; dev++) {
+    marked[dev] = raw(dev);
+  }
+}
+
 void scan() {
+  byte addr[OW_ADDR_LEN];
   for (devs = 0; devs < OW_MAX_DEVS; devs++) {
-    if (!ow.search(addrs[devs])) {
+    if (!ow.search(addr)) {
       break;
     }
+
+    // the reads so far belong to whatever device was here before.
+    if (memcmp(addr, addrs[devs], OW_ADDR_LEN) != 0) {
+      memcpy(addrs[devs], addr, OW_ADDR_LEN);
+      histCount[devs] = 0;
+      histNext[devs] = 0;
+    }
   }
   ow.reset_search();
+
+  // none yet; keep looking, in case they're plugged in later.
+  rescan = (devs == 0);
+
+  // a new device starts at its default.
+  configured = OW_RES_MAX;
+
+#if TEMP_EEPROM
+  save();
+#endif // TEMP_EEPROM
 }
 
-void read(int dev) {
-  byte* addr = addrs[dev];
-  data[dev][0] = TEMP_UNKNOWN;
-  data[dev][1] = TEMP_UNKNOWN;
+#if TEMP_EEPROM
+
+void load() {
+  const byte count = EEPROM.read(EEPROM_DEVS);
+  if ((count == 0) || (count > OW_MAX_DEVS)) {
+    return;  // blank (0xff) or nothing found last time
+  }
+
+  for (byte dev = 0; dev < count; dev++) {
+    for (byte i = 0; i < OW_ADDR_LEN; i++) {
+      addrs[dev][i] = EEPROM.read(EEPROM_ADDRS + (dev * OW_ADDR_LEN) + i);
+    }
+    if (OneWire::crc8(addrs[dev], OW_ADDR_LEN - 1) != addrs[dev][OW_ADDR_LEN - 1]) {
+      return;
+    }
+  }
+
+  devs = count;
+  rescan = false;
+}
+
+// update only writes bytes that have changed, so the same devices cost
+// no wear.
+void save() {
+  EEPROM.update(EEPROM_DEVS, devs);
+  for (byte dev = 0; dev < devs; dev++) {
+    for (byte i = 0; i < OW_ADDR_LEN; i++) {
+      EEPROM.update(EEPROM_ADDRS + (dev * OW_ADDR_LEN) + i, addrs[dev][i]);
+    }
+  }
+}
 
-  // tell DS18B20 to take a temperature reading and put it on the scratchpad.
+#endif // TEMP_EEPROM
+
+// to every DS18B20 at once (skip rom). only the config register is
+// wanted, but the alarm bytes come first; this is for ram, so it's gone
+// if a device loses power, and set again after the next search.
+void configure() {
   if (!ow.reset()) {
     return;
   }
-  ow.select(addr);
-  ow.write(OW_DS18B20_CONVERT);
+  ow.write(OW_ALL_DEVS);
+  ow.write(OW_WRITE_SCRATCH);
+  ow.write(OW_ALARM_HIGH);
+  ow.write(OW_ALARM_LOW);
+  ow.write(OW_CONFIG(resolution));
+  configured = resolution;
+  reconfigure = false;
+}
 
-  // wait for DS18B20 to do it's thing.
-  delay(OW_DELAY);
+// tell every DS18B20 to take a temperature reading and put it on its
+// scratchpad, in one go (skip rom).
+bool convert() {
+  if (!ow.reset()) {
+    return false;
+  }
+  ow.write(OW_ALL_DEVS);
+
+  // bus held high until the next reset; parasite powered devices, all
+  // converting at once, draw on it.
+  ow.write(OW_DS18B20_CONVERT, 1);
+  return true;
+}
+
+// the last reading is kept until this one's in, as the radio may send it
+// while the conversion is running.
+void read(int dev) {
+  byte* addr = addrs[dev];
 
   // tell DS18B20 to read from it's scratchpad.
   if (!ow.reset()) {
+    unknown(dev);
     return;
   }
   ow.select(addr);
   ow.write(OW_READ_SCRATCH);
 
-  data[dev][0] = ow.read();
-  data[dev][1] = ow.read();
+  // all of it, for the crc; a device that's gone reads as all ones,
+  // which doesn't pass.
+  byte scratch[OW_SCRATCH_LEN];
+  for (byte i = 0; i < OW_SCRATCH_LEN; i++) {
+    scratch[i] = ow.read();
+  }
+  if (OneWire::crc8(scratch, OW_SCRATCH_LEN - 1) != scratch[OW_SCRATCH_LEN - 1]) {
+    unknown(dev);
+    return;
+  }
+
+  // a brown out puts the device back at its default resolution, so the
+  // conversion may not have finished in the time allowed; keep the last
+  // reading, and configure again before the next.
+  if (scratch[OW_SCRATCH_CONFIG] != OW_CONFIG(configured)) {
+    reconfigure = true;
+    return;
+  }
+
+  // low bits aren't defined below 12 bits.
+  data[dev][0] = scratch[0] & (0xFF << (OW_RES_MAX - configured));
+  data[dev][1] = scratch[1];
+  histAdd(dev);
+}
+
+// over the oldest, once the ring is full.
+void histAdd(int dev) {
+  hist[dev][histNext[dev]] = raw(dev);
+  histNext[dev] = (histNext[dev] + 1) % HIST_LEN;
+  if (histCount[dev] < HIST_LEN) {
+    histCount[dev]++;
+  }
+  histAge[dev] = 0;
+}
+
+// catches up a second at a time if the loop was held up.
+void histTick() {
+  while ((millis() - ageTick) >= 1000) {
+    ageTick += 1000;
+    for (byte dev = 0; dev < OW_MAX_DEVS; dev++) {
+      if (histAge[dev] < AGE_MAX) {
+        histAge[dev]++;
+      }
+    }
+  }
+}
 
-  // HACK: ignore the rest of the data
-  // TODO: is this really needed?
-  // TODO: if everything seems fine, remove this.
-  // delay(100);
+// the device may have gone (or been swapped), so search the bus again
+// before the next read.
+void unknown(int dev) {
+  data[dev][0] = TEMP_UNKNOWN;
+  data[dev][1] = TEMP_UNKNOWN;
+  rescan = true;
 }
 
 #endif  // TEMP_EN
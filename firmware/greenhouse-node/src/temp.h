@@ -4,8 +4,15 @@
 
 #if TEMP_EN
 
+void temp_init();
 void temp_loop();
+void temp_rescan();
+bool temp_resolution(byte bits);
 byte temp_devs();
 byte temp_data(byte dev, byte part);
+byte temp_all(byte* out);
+byte temp_stats(byte* out);
+bool temp_moved(byte delta);
+void temp_mark();
 
 #endif // TEMP_EN
@@ -1,39 +1,444 @@
 #pragma once
 
+#include <string.h>
+
+#if ARDUINO
+#include <RHCRC.h>
+#else
+#include <stdint.h>
+
+// no radiohead off-target (native tests, simulation); same as RHCRC.
+inline uint16_t RHcrc_ccitt_update(uint16_t crc, uint8_t data)
+{
+  data ^= crc & 0xFF;
+  data ^= data << 4;
+  return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
+#endif // ARDUINO
+
 #define GH_ADDR_MAIN 0x01
 #define GH_ADDR_NODE_1 0x02
 #define GH_ADDR_NODE_2 0x03
+#define GH_ADDR_WINDOWS 0xF0         // group: all window (motor) nodes
+#define GH_ADDR_IS_GROUP(addr) ((addr) >= 0xF0)
+
+#define GH_GROUP_ACK_SLOT 100        // ms per node index; group members ack in turn
+#define GH_NODE_INDEX(addr) ((addr) - GH_ADDR_NODE_1)
+
+// a sequence counts in its low 7 bits; the top bit is set on group
+// requests, so a member's group ack can't be taken for its reply to a
+// unicast request in flight at the same time.
+#define GH_SEQ_GROUP 0x80
+#define GH_SEQ_NEXT(seq) (((seq) & GH_SEQ_GROUP) | (((seq) + 1) & 0x7F))
+#define GH_SEQ_DIFF(a, b) (((int8_t)(((a) - (b)) << 1)) >> 1) // a - b, -64 to 63
 
 #define GH_CMD_ACK 0x01              // generic response
 #define GH_CMD_ERROR 0x02            // something bad happened (d1: code)
 #define GH_CMD_HELLO 0x03            // say hello (d1: sequence)
+#define GH_CMD_LINK 0x04             // change link after the ack (d1: GH_LINK_)
 #define GH_CMD_TEMP_DEVS_REQ 0x10    // request temp device count
 #define GH_CMD_TEMP_DEVS_RSP 0x11    // respond temp device count
 #define GH_CMD_TEMP_DATA_REQ 0x12    // request temp data (d1: device index)
 #define GH_CMD_TEMP_DATA_RSP 0x13    // respond temp data (d1 + d2: raw ow data)
+#define GH_CMD_TEMP_ALL_REQ 0x14     // request temp data for all devices
+#define GH_CMD_TEMP_ALL_RSP 0x15     // respond all temp data (d1: device count, d2+: raw ow data)
+#define GH_CMD_TEMP_SUB 0x16         // push temp data (d1: interval secs, 0 = stop, d2: delta)
+#define GH_CMD_TEMP_PUSH 0x17        // pushed temp data, unsolicited (as GH_CMD_TEMP_ALL_RSP)
+#define GH_CMD_TEMP_RESCAN 0x18      // search the bus for temp devices before the next read
+#define GH_CMD_TEMP_RES 0x19         // temp resolution, before the next read (d1: bits)
+#define GH_CMD_TEMP_STATS_REQ 0x1A   // request temp history stats for all devices
+#define GH_CMD_TEMP_STATS_RSP 0x1B   // respond temp history stats (d1: device count, d2+: stats)
 #define GH_CMD_MOTOR_SPEED 0x20      // motor speed (d1: pwm duty)
-#define GH_CMD_MOTOR_RUN 0x21        // motor run (d1: direction, d2: time)
+#define GH_CMD_MOTOR_RUN 0x21        // motor run, queued if running (d1: direction, d2: time)
 #define GH_CMD_MOTOR_STATE_REQ 0x22  // request motor state
 #define GH_CMD_MOTOR_STATE_RSP 0x23  // respond motor state (d1: true = running)
+#define GH_CMD_BATCH 0x30            // several commands in turn (d1: count, d2+: entries)
+#define GH_CMD_BATCH_RSP 0x31        // respond batch (d1: count, d2+: response entries)
 
 #define GH_ERROR_BAD_CMD 0x01        // invalid command
 #define GH_ERROR_BAD_SEQ 0x02        // duplicate sequence
 #define GH_ERROR_BAD_MOTOR_CMD 0x10  // invalid motor command
+#define GH_ERROR_BAD_LINK 0x20       // invalid link
+#define GH_ERROR_BAD_TEMP_RES 0x30   // invalid temp resolution
+
+// hc-12 link settings, all in FU3 mode, where the rate on air follows the
+// uart baud; faster is shorter range. a node on a faster link goes back
+// to robust by itself if it hears nothing for GH_LINK_FALLBACK.
+#define GH_LINK_ROBUST 0             // 9600 baud (15000 bps on air)
+#define GH_LINK_MEDIUM 1             // 19200 baud (58000 bps on air)
+#define GH_LINK_FAST 2               // 57600 baud (236000 bps on air)
+#define GH_LINK_MAX GH_LINK_FAST
+#define GH_LINK_FALLBACK 30000       // ms
+#define GH_LINK_BAUD(link) (((link) == GH_LINK_FAST) ? 57600UL : (9600UL << (link)))
 
 #define GH_MOTOR_FORWARD 0x01
 #define GH_MOTOR_REVERSE 0x02
 
-// 6-byte datagram
-// 0 = to address
-// 1 = from address
-// 2 = command
-// 3 = sequence (detect duplicates)
-// 4 = data 1
-// 5 = data 2
-#define GH_LENGTH 6
-#define GH_TO(buf) buf[0]
-#define GH_FROM(buf) buf[1]
-#define GH_CMD(buf) buf[2]
-#define GH_SEQ(buf) buf[3]
-#define GH_DATA_1(buf) buf[4]
-#define GH_DATA_2(buf) buf[5]
+#define GH_TEMP_DEVS_MAX 4
+#define GH_TEMP_DELTA_SCALE 16       // temp sub delta units per 1 degree C (raw ow resolution)
+#define GH_TEMP_RES_MIN 9            // bits; 0.5 degree C
+#define GH_TEMP_RES_MAX 12           // bits; 0.0625 degree C, the ds18b20 default
+
+// variable length datagram (v2)
+// 0 = payload length
+// 1 = to address
+// 2 = from address
+// 3 = command
+// 4 = sequence (detect duplicates)
+// 5 = payload start (data 1)
+// 6 = data 2
+// n + 5 = crc16 (low byte), where n is the payload length
+// n + 6 = crc16 (high byte)
+// on a byte stream (hc-12), each frame follows a start of frame marker,
+// which isn't part of the frame (or its crc). it's above the payload
+// max, so a false marker in noise fails the length check straight away.
+// a frame after the fec marker is hamming coded (see gh_fecEncode), two
+// bytes on air per frame byte, so that single bit errors are corrected.
+#define GH_SOF 0xA5
+#define GH_SOF_FEC 0x5A
+#define GH_SOF_LENGTH 1
+#define GH_FEC_LENGTH(length) ((length) * 2)
+#define GH_HEADER_LENGTH 5
+#define GH_CRC_LENGTH 2
+#define GH_PAYLOAD_MAX 32
+#define GH_PAYLOAD_DEFAULT 2
+#define GH_LENGTH_MAX (GH_HEADER_LENGTH + GH_PAYLOAD_MAX + GH_CRC_LENGTH)
+#define GH_LEN(buf) buf[0]
+#define GH_TO(buf) buf[1]
+#define GH_FROM(buf) buf[2]
+#define GH_CMD(buf) buf[3]
+#define GH_SEQ(buf) buf[4]
+#define GH_PAYLOAD(buf) (&buf[GH_HEADER_LENGTH])
+#define GH_DATA_1(buf) buf[5]
+#define GH_DATA_2(buf) buf[6]
+#define GH_FRAME_LENGTH(buf) (GH_HEADER_LENGTH + GH_LEN(buf) + GH_CRC_LENGTH)
+#define GH_CRC_LO(buf) buf[GH_HEADER_LENGTH + GH_LEN(buf)]
+#define GH_CRC_HI(buf) buf[GH_HEADER_LENGTH + GH_LEN(buf) + 1]
+
+// all temp data response payload
+// 0 = device count (d1)
+// 1 + (n * 2) = raw ow data 1 for device n
+// 2 + (n * 2) = raw ow data 2 for device n
+#define GH_TEMP_ALL_LENGTH(devs) (1 + ((devs) * 2))
+#define GH_TEMP_ALL_DATA(buf, dev, part) GH_PAYLOAD(buf)[1 + ((dev) * 2) + (part)]
+
+// temp stats response payload, over the node's recent reads; min, max
+// and mean are raw ow data (as temp all), age is secs since the last read
+// (capped). a device with no reads has all bytes GH_TEMP_UNKNOWN.
+// 0 = device count (d1)
+// 1 + (n * 7) + part = stats for device n
+#define GH_TEMP_UNKNOWN 0xFF
+#define GH_TEMP_STATS_MIN 0          // 2 bytes
+#define GH_TEMP_STATS_MAX 2          // 2 bytes
+#define GH_TEMP_STATS_MEAN 4         // 2 bytes
+#define GH_TEMP_STATS_AGE 6
+#define GH_TEMP_STATS_ENTRY_LENGTH 7
+#define GH_TEMP_STATS_LENGTH(devs) (1 + ((devs) * GH_TEMP_STATS_ENTRY_LENGTH))
+#define GH_TEMP_STATS_DATA(buf, dev, part) GH_PAYLOAD(buf)[1 + ((dev) * GH_TEMP_STATS_ENTRY_LENGTH) + (part)]
+
+// batch payload; entries are commands with up to two bytes of data each
+// way (not temp all or batch), run in order. each response entry is the
+// reply to its command (e.g. ack, with d1 = command).
+// 0 = entry count (d1)
+// 1 + (n * 3) = command for entry n
+// 2 + (n * 3) = data 1 for entry n
+// 3 + (n * 3) = data 2 for entry n
+#define GH_BATCH_ENTRY_LENGTH 3
+#define GH_BATCH_MAX ((GH_PAYLOAD_MAX - 1) / GH_BATCH_ENTRY_LENGTH)
+#define GH_BATCH_LENGTH(count) (1 + ((count) * GH_BATCH_ENTRY_LENGTH))
+#define GH_BATCH_ENTRY(buf, n, part) GH_PAYLOAD(buf)[1 + ((n) * GH_BATCH_ENTRY_LENGTH) + (part)]
+
+// crc16 (ccitt) over the header and payload
+inline uint16_t gh_crc(const uint8_t *buf)
+{
+  uint16_t crc = 0xFFFF;
+  for (uint8_t i = 0; i < GH_HEADER_LENGTH + GH_LEN(buf); i++) {
+    crc = RHcrc_ccitt_update(crc, buf[i]);
+  }
+  return crc;
+}
+
+// call after the payload length is set and before sending
+inline void gh_crcWrite(uint8_t *buf)
+{
+  const uint16_t crc = gh_crc(buf);
+  GH_CRC_LO(buf) = crc & 0xFF;
+  GH_CRC_HI(buf) = crc >> 8;
+}
+
+// call after a complete frame is received
+inline bool gh_crcCheck(const uint8_t *buf)
+{
+  const uint16_t crc = gh_crc(buf);
+  return (GH_CRC_LO(buf) == (crc & 0xFF)) && (GH_CRC_HI(buf) == (crc >> 8));
+}
+
+inline uint8_t gh_parity(uint8_t b)
+{
+  b ^= b >> 4;
+  b ^= b >> 2;
+  b ^= b >> 1;
+  return b & 1;
+}
+
+// extended hamming (8,4) code for a nibble: data bits at positions 3, 5,
+// 6 and 7 (bits 2, 4, 5, 6), parity at positions 1, 2 and 4, and overall
+// parity in bit 7. corrects one flipped bit, and detects two.
+inline uint8_t gh_fecEncode(uint8_t nibble)
+{
+  const uint8_t d1 = nibble & 1;
+  const uint8_t d2 = (nibble >> 1) & 1;
+  const uint8_t d3 = (nibble >> 2) & 1;
+  const uint8_t d4 = (nibble >> 3) & 1;
+  const uint8_t code = (d1 ^ d2 ^ d4) | ((d1 ^ d3 ^ d4) << 1) | (d1 << 2) | ((d2 ^ d3 ^ d4) << 3) |
+                       (d2 << 4) | (d3 << 5) | (d4 << 6);
+  return code | (gh_parity(code) << 7);
+}
+
+// returns bits corrected (0 or 1), or -1 if there were too many to fix.
+inline int8_t gh_fecDecode(uint8_t code, uint8_t *nibble)
+{
+  // position of a single flipped bit, or 0 if it's the overall parity.
+  const uint8_t syndrome =
+    gh_parity(code & 0x55) | (gh_parity(code & 0x66) << 1) | (gh_parity(code & 0x78) << 2);
+
+  int8_t corrected = 0;
+  if (gh_parity(code)) {
+    code ^= (syndrome != 0) ? (1 << (syndrome - 1)) : 0x80;
+    corrected = 1;
+  }
+  else if (syndrome != 0) {
+    return -1;
+  }
+
+  *nibble = ((code >> 2) & 1) | (((code >> 4) & 1) << 1) | (((code >> 5) & 1) << 2) |
+            (((code >> 6) & 1) << 3);
+  return corrected;
+}
+
+// high nibble first.
+inline void gh_fecEncodeByte(uint8_t b, uint8_t *out)
+{
+  out[0] = gh_fecEncode(b >> 4);
+  out[1] = gh_fecEncode(b & 0x0F);
+}
+
+// incremental frame parser for a byte stream; frames land in buf, without
+// the marker (and decoded, for fec frames). after a bad plain frame (noise
+// taken for a marker, or a lost byte), it starts again from the next
+// marker already read, rather than losing everything up to the end of the
+// frame. a fec frame that can't be decoded is dropped.
+#define GH_PARSE_NONE 0    // need more bytes
+#define GH_PARSE_FRAME 1   // buf has a frame with a good crc
+#define GH_PARSE_DROPPED 2 // gave up on a frame, no marker to resync to
+#define GH_PARSE_RESYNC 3  // (internal) resynced to a plain marker
+
+struct gh_parser {
+  uint8_t *buf;      // GH_LENGTH_MAX
+  uint8_t length;    // bytes in buf
+  bool sync;         // marker seen, reading a frame
+  bool fec;          // frame is hamming coded
+  bool half;         // fec; high nibble read
+  uint8_t high;      // fec; high nibble
+  uint8_t corrected; // fec; bits corrected in this frame
+};
+
+inline void gh_parseInit(gh_parser *parser, uint8_t *buf)
+{
+  parser->buf = buf;
+  parser->length = 0;
+  parser->sync = false;
+  parser->fec = false;
+  parser->half = false;
+  parser->high = 0;
+  parser->corrected = 0;
+}
+
+inline bool gh_parseStart(gh_parser *parser, uint8_t b)
+{
+  parser->length = 0;
+  parser->sync = (b == GH_SOF) || (b == GH_SOF_FEC);
+  parser->fec = (b == GH_SOF_FEC);
+  parser->half = false;
+  parser->corrected = 0;
+  return parser->sync;
+}
+
+inline uint8_t gh_parseFrame(gh_parser *parser, uint8_t b);
+
+inline uint8_t gh_parseFec(gh_parser *parser, uint8_t code)
+{
+  uint8_t nibble;
+  const int8_t corrected = gh_fecDecode(code, &nibble);
+  if (corrected < 0) {
+    // the frame is lost, but this may be the next one starting.
+    gh_parseStart(parser, code);
+    return GH_PARSE_DROPPED;
+  }
+  parser->corrected += corrected;
+
+  if (!parser->half) {
+    parser->high = nibble;
+    parser->half = true;
+    return GH_PARSE_NONE;
+  }
+  parser->half = false;
+  return gh_parseFrame(parser, (parser->high << 4) | nibble);
+}
+
+// drop up to and including the next marker in buf (plain frames only, so
+// buf has the bytes as they arrived).
+inline uint8_t gh_parseResync(gh_parser *parser)
+{
+  uint8_t i = 0;
+  while ((i < parser->length) && (parser->buf[i] != GH_SOF) && (parser->buf[i] != GH_SOF_FEC)) {
+    i++;
+  }
+
+  if (i >= parser->length) {
+    parser->length = 0;
+    parser->sync = false;
+    return GH_PARSE_DROPPED;
+  }
+
+  if (parser->buf[i] == GH_SOF) {
+    parser->length -= i + 1;
+    memmove(parser->buf, parser->buf + i + 1, parser->length);
+    return GH_PARSE_RESYNC;
+  }
+
+  // decode what's left in place; it's written behind where it's read.
+  const uint8_t end = parser->length;
+  uint8_t result = GH_PARSE_NONE;
+  gh_parseStart(parser, GH_SOF_FEC);
+  for (uint8_t j = i + 1; (j < end) && (result == GH_PARSE_NONE); j++) {
+    result = gh_parseFec(parser, parser->buf[j]);
+  }
+  return result;
+}
+
+// adds a byte (decoded, for fec) to the frame.
+inline uint8_t gh_parseFrame(gh_parser *parser, uint8_t b)
+{
+  parser->buf[parser->length++] = b;
+
+  // after a resync there may be more than one byte to look at.
+  while (parser->length >= GH_HEADER_LENGTH) {
+    if (GH_LEN(parser->buf) <= GH_PAYLOAD_MAX) {
+      if (parser->length < GH_FRAME_LENGTH(parser->buf)) {
+        return GH_PARSE_NONE;
+      }
+      if (gh_crcCheck(parser->buf)) {
+        parser->sync = false;
+        return GH_PARSE_FRAME;
+      }
+    }
+
+    if (parser->fec) {
+      parser->sync = false;
+      return GH_PARSE_DROPPED;
+    }
+
+    const uint8_t result = gh_parseResync(parser);
+    if (result != GH_PARSE_RESYNC) {
+      return result;
+    }
+  }
+  return GH_PARSE_NONE;
+}
+
+inline uint8_t gh_parse(gh_parser *parser, uint8_t b)
+{
+  if (!parser->sync) {
+    gh_parseStart(parser, b);
+    return GH_PARSE_NONE;
+  }
+  return parser->fec ? gh_parseFec(parser, b) : gh_parseFrame(parser, b);
+}
+
+// recently seen sequences from each sender, so that a retry or a late
+// duplicate isn't run twice; bit n of seen is top - n. the last request
+// handled is kept, so that its reply can be built again if the sender
+// missed it. group frames have a window of their own (keyed by the group
+// address), as a group retry can come after a unicast request.
+#define GH_DEDUPE_SENDERS 2 // main unicast and main group
+#define GH_DEDUPE_BITS 16   // recent sequences remembered per sender
+
+struct gh_dedupeWindow {
+  uint8_t key;     // sender or group address; 0 for none
+  uint8_t top;     // newest sequence seen
+  uint16_t seen;
+  uint8_t lastSeq; // last request handled
+  uint8_t lastCmd; // 0 for none
+};
+
+struct gh_dedupe {
+  gh_dedupeWindow windows[GH_DEDUPE_SENDERS];
+  uint8_t next; // replaced by the next new sender
+};
+
+inline void gh_dedupeInit(gh_dedupe *dedupe) { memset(dedupe, 0, sizeof(gh_dedupe)); }
+
+// a new sender replaces the oldest.
+inline gh_dedupeWindow *gh_dedupeFind(gh_dedupe *dedupe, uint8_t key, uint8_t seq)
+{
+  for (uint8_t i = 0; i < GH_DEDUPE_SENDERS; i++) {
+    if (dedupe->windows[i].key == key) {
+      return &dedupe->windows[i];
+    }
+  }
+
+  gh_dedupeWindow *window = &dedupe->windows[dedupe->next];
+  dedupe->next = (dedupe->next + 1) % GH_DEDUPE_SENDERS;
+  window->key = key;
+  window->top = seq - 1;
+  window->seen = 0;
+  window->lastCmd = 0;
+  return window;
+}
+
+// true if seq has been seen from this sender; marks it seen. hello starts
+// a new session (the sender may have restarted).
+inline bool gh_dedupeSeen(gh_dedupeWindow *window, uint8_t seq, bool hello)
+{
+  const int8_t ahead = GH_SEQ_DIFF(seq, window->top);
+  if (hello) {
+    window->top = seq;
+    window->seen = 1;
+    return false;
+  }
+
+  if (ahead > 0) {
+    window->seen = (ahead < GH_DEDUPE_BITS) ? ((window->seen << ahead) | 1) : 1;
+    window->top = seq;
+    return false;
+  }
+
+  const uint8_t back = -ahead;
+  if (back >= GH_DEDUPE_BITS) {
+    // too far behind to be a retry; start again from here.
+    window->top = seq;
+    window->seen = 1;
+    return false;
+  }
+
+  const uint16_t bit = 1U << back;
+  if (window->seen & bit) {
+    return true;
+  }
+  window->seen |= bit;
+  return false;
+}
+
+// a seen request that's the last one handled is a retry, and gets the
+// same reply again; anything older is dropped.
+inline bool gh_dedupeIsLast(const gh_dedupeWindow *window, uint8_t cmd, uint8_t seq)
+{
+  return (window->lastCmd == cmd) && (window->lastSeq == seq);
+}
+
+inline void gh_dedupeHandled(gh_dedupeWindow *window, uint8_t cmd, uint8_t seq)
+{
+  window->lastCmd = cmd;
+  window->lastSeq = seq;
+}